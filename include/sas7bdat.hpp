@@ -128,6 +128,16 @@ struct ColumnInfo {
   enum ColumnFormat format;
 };
 
+// Run of columns that are adjacent in a row and have the same format and length, ie. column k of
+// the span is at offset + k * column_len.
+struct ColumnSpan {
+  size_t first_column; // Index into FileInfo.column_order
+  size_t n_columns;
+  size_t offset;
+  uint32_t column_len;
+  enum ColumnFormat format;
+};
+
 struct FileInfo {
   bool is_32_bit;
   bool is_little_endian;
@@ -136,6 +146,10 @@ struct FileInfo {
   size_t page_count;
   size_t row_count, column_count;
   struct ColumnInfo *columns;
+  // Access plan: indices into 'columns' ordered by offset, and the spans they form
+  const size_t *column_order;
+  const struct ColumnSpan *spans;
+  size_t span_count;
 };
 
 struct FormatOverride {
@@ -144,27 +158,224 @@ struct FormatOverride {
   size_t len;
 };
 
+enum RowFilterOp {
+  // Comparisons of a numeric column with 'value'. Missing values never match.
+  row_filter_lt,
+  row_filter_le,
+  row_filter_gt,
+  row_filter_ge,
+  row_filter_eq,
+  row_filter_ne,
+  row_filter_between, // value <= x <= value2
+  row_filter_is_null,
+  row_filter_not_null,
+  // Combine the results of the previous two terms
+  row_filter_and,
+  row_filter_or,
+};
+
+// Row filters are given in postfix notation, eg. "a < 1 AND (b IS NULL OR c > 2)" is
+// [a < 1] [b IS NULL] [c > 2] [OR] [AND]. Values are in SAS units, ie. days (dates) or
+// seconds (datetimes) since 1960-01-01.
+struct RowFilterTerm {
+  enum RowFilterOp op;
+  const char *column_name; // Any column, not necessarily a selected one
+  double value, value2;
+  // The values are seconds since 1960-01-01 whatever the column's format, and are converted to
+  // days for date columns. The column must be a date or datetime column.
+  bool datetime_values;
+};
+
+// All memory of a parser is bump-allocated from an arena. By default each parser owns one that
+// parser_deinit() frees. A caller-supplied arena (ParserConfig.arena) lets many parsers reuse the
+// same memory: it is not freed by parser_deinit(), call parser_arena_reset() after deinitializing
+// its parsers instead. An arena must only be used from one thread at a time.
+struct ParserArena;
+size_t parser_arena_struct_size();
+void parser_arena_init(struct ParserArena *arena);
+void parser_arena_reset(struct ParserArena *arena); // Frees all allocations, keeps memory
+void parser_arena_deinit(struct ParserArena *arena);
+
 struct ParserConfig {
   void *userdata;
   size_t filesize_override;
+  // Column names in the configuration are compared byte for byte with the names in the file,
+  // and if the file's encoding is a single-byte encoding, also with the names transcoded to
+  // UTF-8.
+  // Terminated by an entry with column_name == NULL. Matched by column name; the first override
+  // of a column wins.
   const struct FormatOverride *column_format_overrides;
+  // NULL-terminated list of names of the columns to read, or NULL to read all columns.
+  // FileInfo.columns only contains the selected columns, in file order.
+  const char *const *selected_columns;
+  // Only rows that match the filter are passed to on_row/on_rows. Skipped rows count towards
+  // parser_row_index().
+  const struct RowFilterTerm *row_filter;
+  size_t row_filter_len;
+  // Only read the metadata. parse() must not be called; on_row/on_rows may be NULL.
+  bool metadata_only;
   size_t max_rows;
   size_t max_pages;
+  // Arena to allocate the parser's memory from, or NULL to use a parser-owned arena.
+  struct ParserArena *arena;
   void (*on_pagefault)(void *userdata, size_t requested_data_start, size_t requested_data_len,
                        size_t *new_data_offset, const uint8_t **new_data, size_t *new_data_len);
   void (*on_metadata)(void *userdata, const struct FileInfo *);
   bool (*on_row)(void *userdata, const uint8_t *buf, bool have_fast_space_offsets);
+  // If set, used instead of on_row. Called with runs of n_rows rows that are 'stride' bytes apart.
+  // Return the number of rows consumed; consuming fewer than n_rows makes parse() return, and the
+  // next call to parse() continues with the first row that was not consumed.
+  size_t (*on_rows)(void *userdata, const uint8_t *first_row, size_t n_rows, size_t stride,
+                    bool have_fast_space_offsets);
 };
 
 struct Parser;
 size_t parser_struct_size();
 void parser_init(struct Parser *Parser, const struct ParserConfig *config);
 bool parse(struct Parser *parser);
-void parser_deinit(struct Parser *parser); // Not thread safe if children exist
+void parser_deinit(struct Parser *parser); // Children must be deinitialized first
+
+// Position the parser so that the next call to parse() starts at the first row of page
+// 'page_idx' or at row 'row_idx', respectively. Seeking to a row reads page headers only.
+// Return false if the page/row is past the end of the file.
+// Seeking backwards requires an on_pagefault that can serve previously returned data.
+bool parser_seek_page(struct Parser *parser, size_t page_idx);
+bool parser_seek_row(struct Parser *parser, size_t row_idx);
+
+// Read all page headers to build an index of the first row of each page.
+// Makes parser_seek_row() O(log pages) and parser_seek_page() update parser_row_index().
+void parser_build_page_index(struct Parser *parser);
+
+// Serialize the page index (building it first if necessary), eg. to store it next to the file.
+// Return the size of the index, which is only complete if it is <= buf_len.
+size_t parser_serialize_page_index(struct Parser *parser, uint8_t *buf, size_t buf_len);
+// Use a page index written by parser_serialize_page_index(). Return false (and don't use it) if
+// it was written for a different file or a different version of the file.
+// Pages are then parsed without decoding their page headers and subheader pointers.
+bool parser_load_page_index(struct Parser *parser, const uint8_t *buf, size_t buf_len);
+
+// Index of the row passed to the current on_row() call (first row for on_rows()).
+// Unknown after parser_seek_page() without a page index.
+size_t parser_row_index(const struct Parser *parser);
+
+// Serialize everything parse() needs (file layout and all columns, before column selection)
+// into 'buf'. Return the size of the state, which is only complete if it is <= buf_len.
+size_t parser_serialize_state(const struct Parser *parser, uint8_t *buf, size_t buf_len);
+// Initialize a parser from a serialized state without reading the file's metadata.
+// The parser starts at the first row; use parser_seek_*() to start elsewhere.
+// config->column_format_overrides is not used; overrides of the serialized parser apply.
+void parser_init_from_state(struct Parser *parser, const struct ParserConfig *config,
+                            const uint8_t *state, size_t state_len);
+
+// Child parsers share the metadata of their (initialized) parent but have their own buffers and
+// position, so that they can be used from other threads. config->on_metadata,
+// config->selected_columns and config->row_filter are not used. Give each child its own
+// config->arena (or none).
+void parser_init_child(struct Parser *child, const struct Parser *parent,
+                       const struct ParserConfig *config);
+
+// Parse all rows with one thread per child parser. Pages are distributed among the children
+// using work stealing; each child calls its on_row() for the rows of a page in order, so use
+// parser_row_index() to find the global position of a row. The return value of on_row() is
+// ignored; on_rows() is called again with the rows it did not consume. The first error raised
+// in any of the threads stops all threads and is rethrown.
+void parse_parallel(struct Parser *parser, struct Parser *const *children, size_t n_children);
+
+// Built-in on_pagefault that reads the file 'fd' with pread(). A background thread reads ahead
+// into a ring of n_buffers (>= 2) buffers of buffer_size bytes so that I/O overlaps parsing.
+// Call it from on_pagefault with the FileSource as 'source'. Seeking backwards is supported.
+// Requests spanning two buffers are read synchronously.
+struct FileSource;
+size_t file_source_struct_size();
+void file_source_init(struct FileSource *source, int fd, size_t file_size, size_t buffer_size,
+                      size_t n_buffers);
+void file_source_deinit(struct FileSource *source);
+void file_source_on_pagefault(void *source, size_t requested_data_start,
+                              size_t requested_data_len, size_t *new_data_offset,
+                              const uint8_t **new_data, size_t *new_data_len);
+
+// Arrow C data interface export (see src/arrow_c_data.hpp). An ArrowBatchBuilder collects the
+// rows passed to on_rows() into Arrow columnar buffers and exports them as record batches, ie.
+// struct arrays with one child per column. Column types:
+//   string: large_utf8, transcoded from the file encoding, or large_binary if the encoding is
+//           raw or not supported
+//   raw: fixed_size_binary; double, float, bool, (u)int8...(u)int64: the same type
+//   date: date32; datetime: timestamp[s]
+// Missing numbers (and blank strings if blank_as_null) are null. Trailing blanks are stripped.
+struct ArrowArray;
+struct ArrowSchema;
+struct ArrowArrayStream;
+struct ArrowBatchBuilder;
+size_t arrow_batch_builder_struct_size();
+// Batches have at most 'capacity' rows. 'fileinfo' must outlive the builder. If strings_only,
+// batches only have the string columns, eg. to use Arrow strings next to other column storage.
+void arrow_batch_builder_init(struct ArrowBatchBuilder *builder, const struct FileInfo *fileinfo,
+                              enum Encoding encoding, bool blank_as_null, bool strings_only,
+                              size_t capacity);
+void arrow_batch_builder_deinit(struct ArrowBatchBuilder *builder);
+// Call from on_rows(). Return the number of rows appended, which is less than n_rows if the
+// batch is full.
+size_t arrow_batch_builder_append(struct ArrowBatchBuilder *builder, const struct Parser *parser,
+                                  const uint8_t *first_row, size_t n_rows, size_t stride,
+                                  bool have_fast_space_offsets);
+size_t arrow_batch_builder_length(const struct ArrowBatchBuilder *builder);
+// Export the rows appended so far and start a new, empty batch
+void arrow_batch_builder_finish(struct ArrowBatchBuilder *builder, struct ArrowArray *out);
+void arrow_batch_builder_export_schema(const struct ArrowBatchBuilder *builder,
+                                       struct ArrowSchema *out);
+void arrow_schema_deep_copy(const struct ArrowSchema *src, struct ArrowSchema *dst);
+// Stream of exported batches. Moves from 'schema' and 'batches'.
+void arrow_batch_stream_init(struct ArrowArrayStream *stream, struct ArrowSchema *schema,
+                             struct ArrowArray *batches, size_t n_batches);
+
+// Arrow IPC file (Feather v2) writer. Record batches are written as they are passed, so memory
+// use does not depend on the number of rows. Call arrow_ipc_writer_finish() after the last batch
+// to write the footer; the file is not readable without it.
+struct ArrowIpcWriter;
+size_t arrow_ipc_writer_struct_size();
+// Writes the file header and 'schema', which must be a struct as exported by an ArrowBatchBuilder
+void arrow_ipc_writer_init(struct ArrowIpcWriter *writer, int fd, const struct ArrowSchema *schema);
+void arrow_ipc_writer_deinit(struct ArrowIpcWriter *writer);
+void arrow_ipc_writer_write_batch(struct ArrowIpcWriter *writer, const struct ArrowArray *batch);
+void arrow_ipc_writer_finish(struct ArrowIpcWriter *writer);
 
 // ????????????????sssssssssssssssssssssssss
 //                 ^
 size_t column_last_known_space_offset(const struct Parser *, const struct ColumnInfo *);
+// Same for row 'batch_row_idx' of the current on_rows() call
+size_t column_last_known_space_offset_in_batch(const struct Parser *, const struct ColumnInfo *,
+                                               size_t batch_row_idx);
+
+// Dictionary encoding of string columns. Each distinct value (without trailing blanks) gets a
+// code, in order of first occurrence. Codes are stable for the lifetime of the memo, so a memo
+// can be used for all chunks of a file.
+struct StringMemo;
+size_t string_memo_struct_size();
+// At most 'max_size' distinct values
+void string_memo_init(struct StringMemo *memo, size_t max_size);
+void string_memo_deinit(struct StringMemo *memo);
+size_t string_memo_size(const struct StringMemo *memo);
+const uint8_t *string_memo_value(const struct StringMemo *memo, size_t code, size_t *len);
+// Call from on_rows(). Store the codes of the column 'colinfo' of n_rows rows in 'codes' (-1 for
+// blank values if blank_as_null). Return the number of rows encoded, which is less than n_rows if
+// a row has a new value and the memo is full.
+size_t string_memo_encode(struct StringMemo *memo, const struct Parser *parser,
+                          const struct ColumnInfo *colinfo, const uint8_t *first_row,
+                          size_t n_rows, size_t stride, bool have_fast_space_offsets,
+                          bool blank_as_null, int32_t *codes);
+
+// Statistics of the values of a numeric column, to find the narrowest lossless ColumnFormat.
+// Updating with more values only ever widens the format.
+struct NumberStats {
+  size_t count;
+  bool any_missing, all_integral, all_float32_exact;
+  double min, max;
+};
+void number_stats_init(struct NumberStats *stats);
+void number_stats_update(struct NumberStats *stats, const double *values, size_t n);
+// One of (u)int8...(u)int64 if there are no missing values and all values are integers in range,
+// otherwise float (if exact) or double. Never bool: 0/1 columns are usually numbers, too.
+enum ColumnFormat number_stats_narrowest_format(const struct NumberStats *stats);
 
 static bool machine_is_little_endian() {
   int x = 1;
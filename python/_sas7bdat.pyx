@@ -2,17 +2,22 @@
 # TODO(perf) eliminate lists, none checks, ...
 cimport cython
 cimport numpy as np
+from cpython.exc cimport PyErr_Occurred
 from cpython.object cimport PyObject
+from cpython.pycapsule cimport (PyCapsule_Destructor, PyCapsule_GetPointer,
+                                 PyCapsule_New)
 from cpython.ref cimport Py_INCREF
-from libc.stdlib cimport free, malloc
+from libc.stdlib cimport free, malloc, realloc
 from libc.string cimport memcpy, strlen
 from libcpp cimport bool
 from numpy cimport (PyArray_GETPTR1, float32_t, float64_t, int8_t, int16_t,
-                    int32_t, int64_t, uint8_t, uint32_t)
+                    int32_t, int64_t, uint8_t, uint16_t, uint32_t, uint64_t)
 
 import codecs
+import datetime
 import mmap
 import os
+import warnings
 
 import numpy as np
 
@@ -33,28 +38,99 @@ cdef extern from "../include/sas7bdat.hpp":
         column_format_float,
         column_format_bool,
         column_format_int8,
+        column_format_uint8,
         column_format_int16,
+        column_format_uint16,
         column_format_int32,
+        column_format_uint32,
         column_format_int64,
+        column_format_uint64,
         column_format_date,
         column_format_datetime
 
     void decimal2double(const uint8_t *buf, size_t len, bool file_is_little_endian, double *out)
-    bool column_format_is_floating(ColumnFormat fmt)
-    bool column_format_is_date_time(ColumnFormat fmt)
+    bool column_format_is_floating(ColumnFormat fmt) nogil
+    bool column_format_is_date_time(ColumnFormat fmt) nogil
     bool is_sas_space(uint8_t value)
 
     enum Encoding:
-        # Only relevant subset here
         encoding_infer = -2
         encoding_raw = -1
         encoding_default = 0
         encoding_utf_8 = 20
         encoding_ascii = 28
         encoding_iso_8859_1 = 29
+        encoding_iso_8859_2 = 30
+        encoding_iso_8859_3 = 31
+        encoding_iso_8859_4 = 32
+        encoding_iso_8859_5 = 33
+        encoding_iso_8859_6 = 34
+        encoding_iso_8859_7 = 35
+        encoding_iso_8859_8 = 36
+        encoding_iso_8859_9 = 37
+        encoding_iso_8859_11 = 39
         encoding_iso_8859_15 = 40
+        encoding_cp437 = 41
+        encoding_cp850 = 42
+        encoding_cp852 = 43
+        encoding_cp857 = 44
+        encoding_cp858 = 45
+        encoding_cp862 = 46
+        encoding_cp864 = 47
+        encoding_cp865 = 48
+        encoding_cp866 = 49
+        encoding_cp869 = 50
+        encoding_cp874 = 51
+        encoding_cp921 = 52
+        encoding_cp922 = 53
+        encoding_cp1129 = 54
+        encoding_cp720 = 55
+        encoding_cp737 = 56
+        encoding_cp775 = 57
+        encoding_cp860 = 58
+        encoding_cp863 = 59
+        encoding_windows_1250 = 60
+        encoding_windows_1251 = 61
         encoding_windows_1252 = 62
+        encoding_windows_1253 = 63
+        encoding_windows_1254 = 64
+        encoding_windows_1255 = 65
+        encoding_windows_1256 = 66
+        encoding_windows_1257 = 67
+        encoding_windows_1258 = 68
+        encoding_macroman = 69
+        encoding_macarabic = 70
+        encoding_machebrew = 71
+        encoding_macgreek = 72
+        encoding_macthai = 73
+        encoding_macturkish = 75
+        encoding_macukraine = 76
+        encoding_cp950 = 118
+        encoding_euc_tw = 119
+        encoding_big_5 = 123
+        encoding_euc_cn = 125
+        encoding_zwin = 126
+        encoding_shift_jis = 128
+        encoding_euc_jp = 134
+        encoding_cp949 = 136
+        encoding_cp942 = 137
+        encoding_cp932 = 138
+        encoding_euc_kr = 140
+        encoding_kpce = 141
+        encoding_kwin = 142
+        encoding_maciceland = 163
+        encoding_iso_2022_jp = 167
+        encoding_iso_2022_kr = 168
+        encoding_iso_2022_cn = 169
+        encoding_iso_2022_cn_ext = 172
         encoding_any = 204
+        encoding_gb18030 = 205
+        encoding_iso_8859_14 = 227
+        encoding_iso_8859_13 = 242
+        encoding_maccroatian = 245
+        encoding_maccyrillic = 246
+        encoding_macromania = 247
+        encoding_shift_jisx0213 = 248
 
     struct ColumnInfo:
         size_t offset
@@ -62,6 +138,13 @@ cdef extern from "../include/sas7bdat.hpp":
         const char *name
         ColumnFormat format
 
+    struct ColumnSpan:
+        size_t first_column
+        size_t n_columns
+        size_t offset
+        uint32_t column_len
+        ColumnFormat format
+
     struct FileInfo:
         bool is_32_bit
         bool is_little_endian
@@ -71,30 +154,117 @@ cdef extern from "../include/sas7bdat.hpp":
         size_t row_count
         size_t column_count
         const ColumnInfo *columns
+        const size_t *column_order
+        const ColumnSpan *spans
+        size_t span_count
 
     struct FormatOverride:
         const char *column_name
         ColumnFormat format
         size_t len
 
+    enum RowFilterOp:
+        row_filter_lt,
+        row_filter_le,
+        row_filter_gt,
+        row_filter_ge,
+        row_filter_eq,
+        row_filter_ne,
+        row_filter_between,
+        row_filter_is_null,
+        row_filter_not_null,
+        row_filter_and,
+        row_filter_or
+
+    struct RowFilterTerm:
+        RowFilterOp op
+        const char *column_name
+        double value
+        double value2
+        bool datetime_values
+
     struct ParserConfig:
         void *userdata
         size_t filesize_override
         const FormatOverride *column_format_overrides
-        size_t skip_rows
+        const char *const *selected_columns
+        const RowFilterTerm *row_filter
+        size_t row_filter_len
+        bool metadata_only
+        size_t max_rows
+        size_t max_pages
         void (*on_pagefault)(void *userdata, size_t requested_data_start, size_t requested_data_len, size_t *new_data_offset, const uint8_t **new_data, size_t *new_data_len);
         void (*on_metadata)(void *userdata, const FileInfo *)
         bool (*on_row)(void *userdata, const uint8_t *buf, bool have_fast_space_offsets)
+        size_t (*on_rows)(void *userdata, const uint8_t *first_row, size_t n_rows, size_t stride, bool have_fast_space_offsets)
 
     struct Parser:
         pass
 
     size_t parser_struct_size()
     void parser_init(Parser *parser, const ParserConfig *) except +
-    bool parse(Parser *parser) except +
+    bool parse(Parser *parser) except + nogil
     void parser_deinit(Parser *parser) except +
+    bool parser_seek_page(Parser *parser, size_t page_idx) except +
+    bool parser_seek_row(Parser *parser, size_t row_idx) except + nogil
+    size_t parser_serialize_state(const Parser *parser, uint8_t *buf, size_t buf_len)
+    void parser_init_from_state(Parser *parser, const ParserConfig *, const uint8_t *state, size_t state_len) except +
+    size_t parser_serialize_page_index(Parser *parser, uint8_t *buf, size_t buf_len) except +
+    bool parser_load_page_index(Parser *parser, const uint8_t *buf, size_t buf_len) except +
+
+    size_t column_last_known_space_offset_in_batch(const Parser *, const ColumnInfo *, size_t batch_row_idx)
+
+    struct NumberStats:
+        pass
+
+    void number_stats_init(NumberStats *stats)
+    void number_stats_update(NumberStats *stats, const double *values, size_t n)
+    ColumnFormat number_stats_narrowest_format(const NumberStats *stats)
+
+    struct StringMemo:
+        pass
+
+    size_t string_memo_struct_size()
+    void string_memo_init(StringMemo *memo, size_t max_size) except +
+    void string_memo_deinit(StringMemo *memo)
+    size_t string_memo_size(const StringMemo *memo)
+    const uint8_t *string_memo_value(const StringMemo *memo, size_t code, size_t *len)
+    size_t string_memo_encode(StringMemo *memo, const Parser *parser, const ColumnInfo *colinfo, const uint8_t *first_row, size_t n_rows, size_t stride, bool have_fast_space_offsets, bool blank_as_null, int32_t *codes) except +
+
+    struct FileSource:
+        pass
+
+    size_t file_source_struct_size()
+    void file_source_init(FileSource *source, int fd, size_t file_size, size_t buffer_size, size_t n_buffers) except +
+    void file_source_deinit(FileSource *source)
+    void file_source_on_pagefault(void *source, size_t requested_data_start, size_t requested_data_len, size_t *new_data_offset, const uint8_t **new_data, size_t *new_data_len) except + nogil
+
+    struct ArrowBatchBuilder:
+        pass
+
+    size_t arrow_batch_builder_struct_size()
+    void arrow_batch_builder_init(ArrowBatchBuilder *builder, const FileInfo *fileinfo, Encoding encoding, bool blank_as_null, bool strings_only, size_t capacity) except +
+    void arrow_batch_builder_deinit(ArrowBatchBuilder *builder)
+    size_t arrow_batch_builder_append(ArrowBatchBuilder *builder, const Parser *parser, const uint8_t *first_row, size_t n_rows, size_t stride, bool have_fast_space_offsets) except +
+    void arrow_batch_builder_finish(ArrowBatchBuilder *builder, ArrowArray *out) except +
+    void arrow_batch_builder_export_schema(const ArrowBatchBuilder *builder, ArrowSchema *out) except +
+    void arrow_schema_deep_copy(const ArrowSchema *src, ArrowSchema *dst) except +
+    void arrow_batch_stream_init(ArrowArrayStream *stream, ArrowSchema *schema, ArrowArray *batches, size_t n_batches) except +
+
+
+cdef extern from "../src/arrow_c_data.hpp":
+    struct ArrowSchema:
+        const char *format
+        int64_t n_children
+        ArrowSchema **children
+        void (*release)(ArrowSchema *)
 
-    size_t column_last_known_space_offset(const Parser *, const ColumnInfo *)
+    struct ArrowArray:
+        int64_t length
+        void (*release)(ArrowArray *)
+
+    struct ArrowArrayStream:
+        void (*release)(ArrowArrayStream *)
 
 
 # --- String processing ---
@@ -103,13 +273,39 @@ cdef extern from "Python.h":
     unicode PyUnicode_New(Py_ssize_t size, Py_UCS4 maxchar)
     unsigned char *PyUnicode_1BYTE_DATA(PyObject *o)
     unicode PyUnicode_FromStringAndSize(const char *u, Py_ssize_t size)
+    unicode PyUnicode_DecodeUTF8(const char *s, Py_ssize_t size, const char *errors)
 
 cdef extern from "../src/string_utils.hpp":
     size_t rstrip_whitespace(const uint8_t *s, size_t len)
 
+cdef extern from "../src/transpose.hpp":
+    void transpose8(const uint8_t *first_row, size_t n_rows, size_t stride, size_t n_columns, uint8_t *const *out) nogil
+
+cdef extern from "../src/decimal_batch.hpp":
+    void decimal2double_batch(const uint8_t *first, size_t n, size_t stride, size_t len, bool file_is_little_endian, double *out) nogil
+
 cdef extern from "../src/encoding_utils.hpp":
     Encoding detect_iso_8859_15_variant(const uint8_t *s, size_t len)
     Encoding detect_windows_1252_variant(const uint8_t *s, size_t len)
+    Encoding detect_column_encoding(Encoding encoding, const uint8_t *first_cell, size_t n_rows, size_t stride, size_t len)
+
+cdef extern from "../src/utf8.hpp":
+    enum: UTF8_MAX_EXPANSION
+    struct SingleByteCodepage:
+        pass
+    const SingleByteCodepage *single_byte_codepage(Encoding encoding)
+    size_t transcode_single_byte_to_utf8(const SingleByteCodepage *codepage, const uint8_t *s, size_t len, uint8_t *out)
+    void transcode_column_to_utf8(
+        const SingleByteCodepage *codepage,
+        const Parser *parser,
+        const ColumnInfo *colinfo,
+        const uint8_t *first_row,
+        size_t n_rows,
+        size_t stride,
+        bool have_fast_space_offsets,
+        uint8_t *out,
+        int64_t *offsets,
+    ) except +
 
 cdef struct ConstBytestring:
     const uint8_t *data
@@ -119,9 +315,10 @@ cdef inline size_t rstrip_whitespace_fast(
     const Parser *parser,
     const uint8_t *buf,
     const ColumnInfo *colinfo,
+    size_t batch_row_idx,
 ) except? SIZE_MAX:
     # TODO(perf) optimize: 50% of cases within single cell max 4% faster
-    cdef size_t last_known_space = column_last_known_space_offset(parser, colinfo)
+    cdef size_t last_known_space = column_last_known_space_offset_in_batch(parser, colinfo, batch_row_idx)
     if last_known_space <= colinfo.offset or last_known_space == SIZE_MAX:
         return 0
     else:
@@ -147,19 +344,48 @@ cdef inline object decode_string(ConstBytestring s, Encoding encoding, object fa
             encoding = detect_iso_8859_15_variant(s.data, s.len)
         elif encoding == encoding_windows_1252:
             encoding = detect_windows_1252_variant(s.data, s.len)
-        # Inlined version of: .decode(ENCODING_NAMES[encoding])
-        if encoding == encoding_ascii:
-            return fast_decode_ascii(s)
-        elif encoding == encoding_iso_8859_1:
-            return s.data[:s.len].decode("iso-8859-1")
-        elif encoding == encoding_iso_8859_15:
-            return s.data[:s.len].decode("iso-8859-15")
-        elif encoding == encoding_utf_8:
-            return s.data[:s.len].decode("utf-8")
-        elif encoding == encoding_windows_1252:
-            return s.data[:s.len].decode("windows-1252")
-        else:
-            return fallback_decoder(s.data[:s.len])[0]
+        return decode_string_as(s, encoding, fallback_decoder)
+
+cdef class CodepageDecoder:
+    """Decoder of a single-byte encoding with the native tables, f(bytes) -> (str, int)."""
+    cdef const SingleByteCodepage *codepage
+
+    def __call__(self, bytes data):
+        cdef:
+            size_t len_in = len(data)
+            bytearray out = bytearray(len_in * UTF8_MAX_EXPANSION)
+            size_t len_out = transcode_single_byte_to_utf8(
+                self.codepage, <const uint8_t *><const char *>data, len_in, <uint8_t *><char *>out
+            )
+        return PyUnicode_DecodeUTF8(<char *>out, len_out, NULL), len_in
+
+cdef inline bool encoding_is_decoded_inline(Encoding encoding):
+    """If decode_string_as() does not need the fallback decoder for the encoding."""
+    return (
+        encoding == encoding_ascii
+        or encoding == encoding_iso_8859_1
+        or encoding == encoding_iso_8859_15
+        or encoding == encoding_utf_8
+        or encoding == encoding_windows_1252
+    )
+
+cdef inline object decode_string_as(ConstBytestring s, Encoding encoding, object fallback_decoder):
+    """Decode a non-raw string with an already detected encoding, see detect_column_encoding()."""
+    # Inlined version of: .decode(ENCODING_NAMES[encoding])
+    if encoding == encoding_ascii:
+        if s.len == 1:
+            return PyUnicode_FromStringAndSize(<const char *>s.data, 1)
+        return fast_decode_ascii(s)
+    elif encoding == encoding_iso_8859_1:
+        return s.data[:s.len].decode("iso-8859-1")
+    elif encoding == encoding_iso_8859_15:
+        return s.data[:s.len].decode("iso-8859-15")
+    elif encoding == encoding_utf_8:
+        return s.data[:s.len].decode("utf-8")
+    elif encoding == encoding_windows_1252:
+        return s.data[:s.len].decode("windows-1252")
+    else:
+        return fallback_decoder(s.data[:s.len])[0]
 
 
 # --- NumPy array utils ---
@@ -201,25 +427,49 @@ cdef inline np_setitem(np.ndarray ar, size_t idx, setitem_type value):
 # --- Parser context ---
 
 cdef extern from "math.h":
-    bool isnan(double)
+    bool isnan(double) nogil
+
+COLUMN_FORMAT_DTYPES = {
+    column_format_string: "object",
+    column_format_double: "float64",
+    column_format_float: "float32",
+    column_format_bool: "bool",
+    column_format_int8: "int8",
+    column_format_uint8: "uint8",
+    column_format_int16: "int16",
+    column_format_uint16: "uint16",
+    column_format_int32: "int32",
+    column_format_uint32: "uint32",
+    column_format_int64: "int64",
+    column_format_uint64: "uint64",
+    column_format_date: "datetime64[D]",
+    column_format_datetime: "datetime64[s]",
+}
 
 cdef make_np_array_for_column_format(fmt, col_len, row_count):
-    dtype = {
-        column_format_raw: f"S{col_len}",
-        column_format_string: "object",
-        column_format_double: "float64",
-        column_format_float: "float32",
-        column_format_bool: "bool",
-        column_format_int8: "int8",
-        column_format_int16: "int16",
-        column_format_int32: "int32",
-        column_format_int64: "int64",
-        column_format_date: "datetime64[D]",
-        column_format_datetime: "datetime64[s]",
-    }[fmt]
+    dtype = f"S{col_len}" if fmt == column_format_raw else COLUMN_FORMAT_DTYPES[fmt]
     arr = np.ndarray(row_count, dtype=dtype)
     return (arr, arr.view("int64") if dtype.startswith("date") else arr)
 
+COLUMN_FORMAT_NAMES = {
+    column_format_raw: "raw",
+    column_format_string: "string",
+    column_format_double: "double",
+    column_format_float: "float",
+    column_format_bool: "bool",
+    column_format_int8: "int8",
+    column_format_uint8: "uint8",
+    column_format_int16: "int16",
+    column_format_uint16: "uint16",
+    column_format_int32: "int32",
+    column_format_uint32: "uint32",
+    column_format_int64: "int64",
+    column_format_uint64: "uint64",
+    column_format_date: "date",
+    column_format_datetime: "datetime",
+}
+COLUMN_FORMAT_ENUMS = {v: k for k, v in COLUMN_FORMAT_NAMES.items()}
+
 ENCODING_NAMES = {
     encoding_infer: "infer",
     encoding_raw: "raw",
@@ -227,9 +477,68 @@ ENCODING_NAMES = {
     encoding_utf_8: "utf-8",
     encoding_ascii: "ascii",
     encoding_iso_8859_1: "iso-8859-1",
+    encoding_iso_8859_2: "iso-8859-2",
+    encoding_iso_8859_3: "iso-8859-3",
+    encoding_iso_8859_4: "iso-8859-4",
+    encoding_iso_8859_5: "iso-8859-5",
+    encoding_iso_8859_6: "iso-8859-6",
+    encoding_iso_8859_7: "iso-8859-7",
+    encoding_iso_8859_8: "iso-8859-8",
+    encoding_iso_8859_9: "iso-8859-9",
+    encoding_iso_8859_11: "iso-8859-11",
     encoding_iso_8859_15: "iso-8859-15",
+    encoding_cp437: "cp437",
+    encoding_cp850: "cp850",
+    encoding_cp852: "cp852",
+    encoding_cp857: "cp857",
+    encoding_cp858: "cp858",
+    encoding_cp862: "cp862",
+    encoding_cp864: "cp864",
+    encoding_cp865: "cp865",
+    encoding_cp866: "cp866",
+    encoding_cp869: "cp869",
+    encoding_cp874: "cp874",
+    encoding_cp921: "cp921",
+    encoding_cp922: "cp922",
+    encoding_cp1129: "cp1129",
+    encoding_cp720: "cp720",
+    encoding_cp737: "cp737",
+    encoding_cp775: "cp775",
+    encoding_cp860: "cp860",
+    encoding_cp863: "cp863",
+    encoding_windows_1250: "windows-1250",
+    encoding_windows_1251: "windows-1251",
     encoding_windows_1252: "windows-1252",
+    encoding_windows_1253: "windows-1253",
+    encoding_windows_1254: "windows-1254",
+    encoding_windows_1255: "windows-1255",
+    encoding_windows_1256: "windows-1256",
+    encoding_windows_1257: "windows-1257",
+    encoding_windows_1258: "windows-1258",
+    encoding_macroman: "mac-roman",
+    encoding_macarabic: "mac-arabic",
+    encoding_macgreek: "mac-greek",
+    encoding_macturkish: "mac-turkish",
+    encoding_macukraine: "mac-ukraine",
+    encoding_cp950: "cp950",
+    encoding_big_5: "big5",
+    encoding_euc_cn: "gb2312",
+    encoding_shift_jis: "shift-jis",
+    encoding_euc_jp: "euc-jp",
+    encoding_cp949: "cp949",
+    encoding_cp932: "cp932",
+    encoding_euc_kr: "euc-kr",
+    encoding_maciceland: "mac-iceland",
+    encoding_iso_2022_jp: "iso-2022-jp",
+    encoding_iso_2022_kr: "iso-2022-kr",
     encoding_any: "windows-1252",
+    encoding_gb18030: "gb18030",
+    encoding_iso_8859_14: "iso-8859-14",
+    encoding_iso_8859_13: "iso-8859-13",
+    encoding_maccroatian: "mac-croatian",
+    encoding_maccyrillic: "mac-cyrillic",
+    encoding_macromania: "mac-romanian",
+    encoding_shift_jisx0213: "shift-jisx0213",
 }
 ENCODING_ENUMS = {v: k for k, v in ENCODING_NAMES.items()}
 
@@ -237,6 +546,36 @@ cdef object np_nan = np.nan
 cdef bytes empty_bytes = b""
 cdef str empty_string = ""
 
+cdef enum:
+    DECODE_BLOCK_ROWS = 256
+
+cdef void context_on_pagefault(
+    void *ctx,
+    size_t requested_data_start,
+    size_t requested_data_len,
+    size_t *new_data_offset,
+    const uint8_t **new_data,
+    size_t *new_data_len,
+) except * with gil:
+    (<Context>ctx).on_pagefault(requested_data_start, requested_data_len, new_data_offset, new_data, new_data_len)
+
+cdef void context_on_metadata(void *ctx, const FileInfo *fileinfo) except * with gil:
+    (<Context>ctx).on_metadata(fileinfo)
+
+cdef int raise_callback_error() except -1:
+    # The parser does not know about Python exceptions, so an exception raised in
+    # a callback is still pending when the parser function returns
+    return -1 if PyErr_Occurred() else 0
+
+cdef size_t context_on_rows(
+    void *ctx,
+    const uint8_t *first_row,
+    size_t n_rows,
+    size_t stride,
+    bool have_fast_space_offsets,
+) except? SIZE_MAX with gil:
+    return (<Context>ctx).on_rows(first_row, n_rows, stride, have_fast_space_offsets)
+
 cdef class Context:
     cdef:
         void *parser
@@ -246,16 +585,50 @@ cdef class Context:
         size_t sas7bdat_data_len_so_far
         object sas7bdat_data_current_buffer
         const uint8_t[:] sas7bdat_data_current_buffer_view
+        FileSource *file_source
+        ArrowBatchBuilder *arrow_builder  # If the output is Arrow record batches
+        bool arrow
+        ArrowBatchBuilder *string_builder  # Of the string columns, if string_storage == "pyarrow"
+        bool pyarrow_strings
         bool blank_as_nan
         bool copy_arrays
+        bool metadata_only
+        bool infer_dtypes
+        NumberStats *number_stats  # Of each column, if infer_dtypes
+        bool categorical
+        size_t max_categories
+        dict fixed_categories  # Column name -> categories, see __init__()
+        StringMemo **string_memos  # Of each column, NULL for columns that are not categorical
+        list categories  # Decoded values of the string_memos
+        list categorical_dtypes  # Of the categories, cached while the categories are unchanged
+        list category_indexers  # Of columns with fixed categories: memo code -> category code
         size_t chunksize
+        size_t capacity  # Rows per chunk
+        size_t rows_left  # Until max_rows
 
         const FileInfo *fileinfo
         Encoding encoding
         object fallback_decoder  # f(bytes) -> (str, int)
+        const SingleByteCodepage *codepage  # If strings are transcoded natively, see _on_column_codepage()
+        uint8_t *transcode_buf
+        size_t transcode_buf_len
+        int64_t *transcode_offsets
+        size_t transcode_offsets_len
         size_t current_row
         list col_arrs_read
         list col_arrs_write
+        uint8_t **col_data  # Data of the col_arrs_write, to convert numbers without the GIL
+        bool arrays_handed_out  # Parse the next chunk into new arrays, see get_current_chunk_arrays()
+        bool dataframe
+        list blocks  # (2D array, column indices) of the columns of each dtype, if dataframe
+        uint8_t **span_out  # Output pointers of the columns of a span, for transpose8()
+        double decode_buf[DECODE_BLOCK_ROWS]  # Numbers decoded with decimal2double_batch()
+        list usecols_bytes
+        const char **usecols_ptrs
+        list column_formats_names
+        FormatOverride *column_formats
+        list row_filter_names
+        RowFilterTerm *row_filter
 
     def __init__(
         self,
@@ -263,15 +636,50 @@ cdef class Context:
         *,
         blank_as_nan=True,
         chunksize=None,
+        max_rows=None,
         filesize_override=None,
         copy_arrays=True,
         encoding="infer",
+        usecols=None,
+        column_formats=None,
+        filters=None,
+        metadata_only=False,
+        infer_dtypes=False,
+        categorical=False,
+        max_categories=2**16,
+        categories=None,
+        string_storage="python",
+        fd=None,
+        readahead_buffer_size=8 * 1024**2,
+        readahead_buffers=4,
+        arrow=False,
+        dataframe=False,
     ):
         self.sas7bdat_data_buffer_iter = sas7bdat_data_buffer_iter
         self.sas7bdat_data_len_so_far = 0
         self.blank_as_nan = blank_as_nan
         self.chunksize = chunksize or 0
+        self.rows_left = SIZE_MAX if max_rows is None else max_rows
         self.copy_arrays = copy_arrays
+        self.arrow = arrow
+        if dataframe and arrow:
+            raise NotImplementedError("dataframe is not supported with arrow")
+        self.dataframe = dataframe
+        self.infer_dtypes = infer_dtypes
+        if (categorical or categories) and arrow:
+            raise NotImplementedError("categorical is not supported with arrow")
+        # String columns in 'categories' are Categoricals with exactly these categories, eg. from a
+        # first pass over the file; their other values are missing. With categorical=True, the
+        # other string columns are dictionary encoded as they are read, and fall back to strings
+        # from the chunk in which they exceed max_categories on.
+        self.categorical = categorical
+        self.max_categories = max_categories
+        self.fixed_categories = dict(categories or {})
+        if string_storage not in {"python", "pyarrow"}:
+            raise ValueError(f"Unknown string_storage {string_storage!r}")
+        self.pyarrow_strings = string_storage == "pyarrow"
+        if self.pyarrow_strings and (arrow or categorical or categories):
+            raise NotImplementedError("string_storage='pyarrow' is not supported with arrow or categorical")
         if isinstance(encoding, str):
             encoding = ENCODING_ENUMS[encoding]
         self.encoding = encoding
@@ -279,12 +687,116 @@ cdef class Context:
 
         self.config.userdata = <void *>self
         self.config.column_format_overrides = NULL
+        self.config.selected_columns = NULL
+        # The parser matches names in the file's encoding and, for single-byte encodings, in
+        # UTF-8. With encoding="infer" the file's encoding is not known yet, so use UTF-8.
+        name_encoding = ENCODING_NAMES[encoding] if encoding >= 0 else "utf-8"
+        if usecols is not None:
+            self.usecols_bytes = [
+                name if isinstance(name, bytes) else name.encode(name_encoding)
+                for name in usecols
+            ]
+            self.usecols_ptrs = <const char **>malloc((len(self.usecols_bytes) + 1) * sizeof(char *))
+            if self.usecols_ptrs == NULL:
+                raise MemoryError()
+            for i, name in enumerate(self.usecols_bytes):
+                self.usecols_ptrs[i] = name
+            self.usecols_ptrs[len(self.usecols_bytes)] = NULL
+            self.config.selected_columns = self.usecols_ptrs
+        if column_formats:
+            self._init_column_formats(column_formats, name_encoding)
+        self.config.row_filter = NULL
+        self.config.row_filter_len = 0
+        self.config.metadata_only = self.metadata_only = metadata_only
+        if filters:
+            self._init_row_filter(filters, name_encoding)
         self.config.filesize_override = filesize_override or 0
-        self.config.on_pagefault = <void (*)(void *, size_t, size_t, size_t *, const uint8_t **, size_t *)>self.on_pagefault;
-        self.config.on_metadata = <void (*)(void *, const FileInfo *)>self.on_metadata
-        self.config.on_row = <bool (*)(void *, const uint8_t *, bool)>self.on_row
+        if fd is not None:
+            # Read with pread() and a readahead thread instead of from sas7bdat_data_buffer_iter
+            assert filesize_override, "fd requires filesize_override"
+            self.file_source = <FileSource *>malloc(file_source_struct_size())
+            if self.file_source == NULL:
+                raise MemoryError()
+            try:
+                file_source_init(self.file_source, fd, filesize_override, readahead_buffer_size, readahead_buffers)
+            except:
+                free(self.file_source)
+                self.file_source = NULL
+                raise
+        # parse() runs without the GIL; the callbacks take it
+        self.config.on_pagefault = <void (*)(void *, size_t, size_t, size_t *, const uint8_t **, size_t *)>context_on_pagefault
+        self.config.on_metadata = <void (*)(void *, const FileInfo *)>context_on_metadata
+        self.config.on_row = NULL
+        self.config.on_rows = <size_t (*)(void *, const uint8_t *, size_t, size_t, bool)>context_on_rows
+
+    def __dealloc__(self):
+        cdef size_t col_idx
+        if self.arrow_builder != NULL:
+            arrow_batch_builder_deinit(self.arrow_builder)
+            free(self.arrow_builder)
+        if self.string_builder != NULL:
+            arrow_batch_builder_deinit(self.string_builder)
+            free(self.string_builder)
+        if self.file_source != NULL:
+            file_source_deinit(self.file_source)
+            free(self.file_source)
+        free(self.usecols_ptrs)
+        free(self.column_formats)
+        free(self.span_out)
+        free(self.col_data)
+        free(self.transcode_buf)
+        free(self.transcode_offsets)
+        free(self.number_stats)
+        free(self.row_filter)
+        if self.string_memos != NULL:
+            for col_idx in range(self.fileinfo.column_count):
+                self._free_string_memo(col_idx)
+            free(self.string_memos)
+
+    cdef _init_column_formats(self, column_formats, name_encoding):
+        """Read columns as other formats, eg. {"x": "float"}. Numeric columns can be read as
+        any numeric format, string columns as "raw"."""
+        cdef size_t i
+        self.column_formats = <FormatOverride *>malloc((len(column_formats) + 1) * sizeof(FormatOverride))
+        if self.column_formats == NULL:
+            raise MemoryError()
+        self.column_formats_names = []
+        for i, (name, fmt) in enumerate(column_formats.items()):
+            if fmt not in COLUMN_FORMAT_ENUMS:
+                raise ValueError(f"Unknown column format {fmt!r}")
+            self.column_formats_names.append(name if isinstance(name, bytes) else name.encode(name_encoding))
+            self.column_formats[i].column_name = self.column_formats_names[-1]
+            self.column_formats[i].format = COLUMN_FORMAT_ENUMS[fmt]
+            self.column_formats[i].len = 0
+        self.column_formats[len(column_formats)].column_name = NULL
+        self.config.column_format_overrides = self.column_formats
+
+    cdef _init_row_filter(self, filters, name_encoding):
+        cdef size_t i
+        terms = row_filter_to_postfix(filters)
+        self.row_filter = <RowFilterTerm *>malloc(len(terms) * sizeof(RowFilterTerm))
+        if self.row_filter == NULL:
+            raise MemoryError()
+        self.row_filter_names = []
+        for i, (name, op, value, value2, datetime_values) in enumerate(terms):
+            self.row_filter[i].op = op
+            self.row_filter[i].column_name = NULL
+            if name is not None:
+                self.row_filter_names.append(
+                    name if isinstance(name, bytes) else name.encode(name_encoding)
+                )
+                self.row_filter[i].column_name = self.row_filter_names[-1]
+            self.row_filter[i].value = value
+            self.row_filter[i].value2 = value2
+            self.row_filter[i].datetime_values = datetime_values
+        self.config.row_filter = self.row_filter
+        self.config.row_filter_len = len(terms)
 
     cdef void on_pagefault(self, size_t requested_data_start, size_t requested_data_len, size_t *new_data_offset, const uint8_t **new_data, size_t *new_data_len) except *:
+        if self.file_source != NULL:
+            with nogil:
+                file_source_on_pagefault(self.file_source, requested_data_start, requested_data_len, new_data_offset, new_data, new_data_len)
+            return
         # TODO(ref): move this logic into the parse_buffer_iter function like with http_parser?
         # TODO(ref): All of this is too complicated. Replace data_min_offset.
         assert requested_data_start < SIZE_MAX - requested_data_len
@@ -310,38 +822,400 @@ cdef class Context:
         new_data_len[0] = len(self.sas7bdat_data_current_buffer)
 
     cdef void on_metadata(self, const FileInfo *fileinfo) except *:
+        cdef size_t col_idx
         self.fileinfo = fileinfo
         if self.encoding == encoding_infer:
             self.encoding = fileinfo.encoding
-        if self.encoding >= 0:
+        if self.encoding >= 0 and not encoding_is_decoded_inline(self.encoding):
+            self.codepage = single_byte_codepage(self.encoding)
+        if self.codepage != NULL:
+            self.fallback_decoder = CodepageDecoder.__new__(CodepageDecoder)
+            (<CodepageDecoder>self.fallback_decoder).codepage = self.codepage
+        elif self.encoding >= 0:
             self.fallback_decoder = codecs.getdecoder(ENCODING_NAMES[self.encoding])
+        if self.metadata_only:
+            return
+        capacity = min(self.chunksize, fileinfo.row_count) if self.chunksize else fileinfo.row_count
+        capacity = self.capacity = min(capacity, self.rows_left)
+        if self.arrow:
+            self.arrow_builder = make_arrow_batch_builder(fileinfo, self.encoding, self.blank_as_nan, False, capacity)
+            return
+        if self.pyarrow_strings:
+            self.string_builder = make_arrow_batch_builder(fileinfo, self.encoding, self.blank_as_nan, True, capacity)
+            check_arrow_strings_are_utf8(self.string_builder, self.encoding)
         self.col_arrs_read, self.col_arrs_write = map(list, zip(*(
-            make_np_array_for_column_format(
+            (None, None)
+            if self.pyarrow_strings and fileinfo.columns[col_idx].format == column_format_string
+            else make_np_array_for_column_format(
                 fileinfo.columns[col_idx].format,
                 fileinfo.columns[col_idx].len,
-                min(self.chunksize, fileinfo.row_count) if self.chunksize else fileinfo.row_count,
+                capacity,
             )
             for col_idx in range(fileinfo.column_count)
         )))
+        self.span_out = <uint8_t **>malloc(fileinfo.column_count * sizeof(uint8_t *))
+        self.col_data = <uint8_t **>malloc(fileinfo.column_count * sizeof(uint8_t *))
+        if self.span_out == NULL or self.col_data == NULL:
+            raise MemoryError()
+        if self.infer_dtypes:
+            self.number_stats = <NumberStats *>malloc(fileinfo.column_count * sizeof(NumberStats))
+            if self.number_stats == NULL:
+                raise MemoryError()
+            for col_idx in range(fileinfo.column_count):
+                number_stats_init(&self.number_stats[col_idx])
+        if self.categorical or self.fixed_categories:
+            self._init_string_memos(capacity)
+        if self.dataframe:
+            self._init_blocks(capacity)
+        self._update_col_data()
+
+    cdef _update_col_data(self):
+        cdef size_t col_idx
+        for col_idx in range(self.fileinfo.column_count):
+            arr = self.col_arrs_write[col_idx]
+            self.col_data[col_idx] = <uint8_t *>np.PyArray_DATA(arr) if arr is not None else NULL
+
+    cdef _init_blocks(self, size_t capacity):
+        """Allocate the columns of each dtype as the rows of one 2D array, laid out like the
+        blocks of a pandas DataFrame, so that chunks can be made DataFrames without copying.
+        Columns that pandas stores differently (dates, raw bytes, categoricals and strings
+        if pandas infers its string dtype) keep arrays of their own."""
+        import pandas as pd
+        cdef size_t col_idx
+        cdef bool infer_string = pandas_infers_strings(pd)
+        groups = {}
+        for col_idx in range(self.fileinfo.column_count):
+            arr = self.col_arrs_write[col_idx]
+            if (
+                arr is None
+                or arr is not self.col_arrs_read[col_idx]
+                or arr.dtype.kind == "S"
+                or (infer_string and arr.dtype == object)
+                or (self.string_memos != NULL and self.string_memos[col_idx] != NULL)
+            ):
+                continue
+            groups.setdefault(arr.dtype, []).append(col_idx)
+        self.blocks = [
+            (np.empty((len(col_idxs), capacity), dtype=dtype), col_idxs)
+            for dtype, col_idxs in groups.items()
+        ]
+        self._bind_blocks()
+
+    cdef _bind_blocks(self):
+        for block, col_idxs in self.blocks:
+            for i, col_idx in enumerate(col_idxs):
+                self.col_arrs_read[col_idx] = self.col_arrs_write[col_idx] = block[i]
+
+    cdef _new_chunk_arrays(self):
+        """Give the next chunk arrays of its own, so that the previous one can be handed out
+        without copying while the next one is parsed."""
+        in_block = set()
+        if self.blocks:
+            self.blocks = [(np.empty_like(block), col_idxs) for block, col_idxs in self.blocks]
+            self._bind_blocks()
+            in_block.update(col_idx for _, col_idxs in self.blocks for col_idx in col_idxs)
+        for col_idx, (read, write) in enumerate(zip(self.col_arrs_read, self.col_arrs_write)):
+            if write is None or col_idx in in_block:
+                continue
+            self.col_arrs_write[col_idx] = np.empty_like(write)
+            self.col_arrs_read[col_idx] = (
+                self.col_arrs_write[col_idx] if read is write else self.col_arrs_write[col_idx].view(read.dtype)
+            )
+        self._update_col_data()
+
+    cdef _init_string_memos(self, size_t capacity):
+        """Dictionary encode the string columns. Their arrays hold the codes."""
+        import pandas as pd
+        cdef size_t col_idx
+        names = self.get_column_names()
+        string_names = {
+            name
+            for col_idx, name in enumerate(names)
+            if self.fileinfo.columns[col_idx].format == column_format_string
+        }
+        unknown = [name for name in self.fixed_categories if name not in string_names]
+        if unknown:
+            raise ValueError(f"Unknown string columns in categories: {unknown}")
+        self.string_memos = <StringMemo **>malloc(self.fileinfo.column_count * sizeof(StringMemo *))
+        if self.string_memos == NULL:
+            raise MemoryError()
+        self.categories = [None] * self.fileinfo.column_count
+        self.categorical_dtypes = [None] * self.fileinfo.column_count
+        self.category_indexers = [None] * self.fileinfo.column_count
+        for col_idx in range(self.fileinfo.column_count):
+            self.string_memos[col_idx] = NULL
+        for col_idx, name in enumerate(names):
+            if name in self.fixed_categories:
+                self.categorical_dtypes[col_idx] = pd.CategoricalDtype(self.fixed_categories[name])
+                self.category_indexers[col_idx] = np.full(1, -1, dtype="int32")
+            elif not (self.categorical and name in string_names):
+                continue
+            self.string_memos[col_idx] = <StringMemo *>malloc(string_memo_struct_size())
+            if self.string_memos[col_idx] == NULL:
+                raise MemoryError()
+            # Values outside of fixed categories are encoded too, to map them to missing
+            string_memo_init(
+                self.string_memos[col_idx],
+                SIZE_MAX if name in self.fixed_categories else self.max_categories,
+            )
+            self.categories[col_idx] = []
+            self.col_arrs_read[col_idx] = self.col_arrs_write[col_idx] = np.ndarray(capacity, dtype="int32")
 
-    cdef bool on_row(self, const uint8_t *buf, bool have_fast_space_offsets) except? True:
+    cdef _free_string_memo(self, size_t col_idx):
+        if self.string_memos[col_idx] != NULL:
+            string_memo_deinit(self.string_memos[col_idx])
+            free(self.string_memos[col_idx])
+            self.string_memos[col_idx] = NULL
+
+    cdef size_t on_rows(self, const uint8_t *first_row, size_t n_rows, size_t stride, bool have_fast_space_offsets) except? SIZE_MAX:
         cdef:
-            size_t col_idx
+            size_t span_idx, col_idx, span_col_idx, batch_row_idx, first_string_row
+            Encoding encoding
+            const ColumnSpan *span
             const ColumnInfo *colinfo
+            const uint8_t *buf
+
+        # Only consume as many rows as fit into the current chunk and max_rows; parse()
+        # returns if we consume fewer rows than passed.
+        n_rows = min(n_rows, self.rows_left)
+        if self.arrow_builder != NULL:
+            n_rows = arrow_batch_builder_append(
+                self.arrow_builder, <Parser *>self.parser, first_row, n_rows, stride, have_fast_space_offsets
+            )
+            self.current_row += n_rows
+            self.rows_left -= n_rows
+            return n_rows
+
+        n_rows = min(n_rows, self.capacity - self.current_row)
+        if n_rows == 0:
+            return 0
+        if self.arrays_handed_out:
+            self._new_chunk_arrays()
+            self.arrays_handed_out = False
+        if self.string_builder != NULL:
+            arrow_batch_builder_append(
+                self.string_builder, <Parser *>self.parser, first_row, n_rows, stride, have_fast_space_offsets
+            )
 
-        assert self.current_row < len(self.col_arrs_write[0])
+        # Column-major to keep the per-column state (and the output array) hot. Columns are
+        # visited in row order, span by span. Numbers first, without the GIL; only strings
+        # need Python objects.
+        with nogil:
+            self._on_number_spans(first_row, n_rows, stride)
+        for span_idx in range(self.fileinfo.span_count):
+            span = &self.fileinfo.spans[span_idx]
+            if span.format != column_format_raw and span.format != column_format_string:
+                continue
+            if span.format == column_format_string and self.string_builder != NULL:
+                continue
+            for span_col_idx in range(span.n_columns):
+                col_idx = self.fileinfo.column_order[span.first_column + span_col_idx]
+                colinfo = &self.fileinfo.columns[col_idx]
+                first_string_row = 0
+                if self.string_memos != NULL and self.string_memos[col_idx] != NULL:
+                    first_string_row = self._on_column_categorical(col_idx, first_row, n_rows, stride, have_fast_space_offsets)
+                buf = first_row + first_string_row * stride
+                if colinfo.format == column_format_raw:
+                    for batch_row_idx in range(first_string_row, n_rows):
+                        self._on_cell_raw(buf, self.current_row + batch_row_idx, col_idx, colinfo)
+                        buf += stride
+                    continue
+                # One decoder for the whole column chunk, rather than detecting it per cell
+                encoding = self.encoding
+                if encoding != encoding_raw:
+                    encoding = detect_column_encoding(
+                        encoding, buf + colinfo.offset, n_rows - first_string_row, stride, colinfo.len
+                    )
+                if self.codepage != NULL and encoding != encoding_ascii:
+                    self._on_column_codepage(
+                        col_idx, buf, first_string_row, n_rows - first_string_row, stride, have_fast_space_offsets
+                    )
+                    continue
+                for batch_row_idx in range(first_string_row, n_rows):
+                    self._on_cell_string(
+                        buf,
+                        self.current_row + batch_row_idx,
+                        col_idx,
+                        colinfo,
+                        encoding,
+                        have_fast_space_offsets,
+                        batch_row_idx,
+                    )
+                    buf += stride
+
+        self.current_row += n_rows
+        self.rows_left -= n_rows
+        return n_rows
+
+    cdef bool _on_column_codepage(
+        self,
+        size_t col_idx,
+        const uint8_t *first_row,
+        size_t batch_row_start,
+        size_t n_rows,
+        size_t stride,
+        bool have_fast_space_offsets,
+    ) except False:
+        """Decode a string column of a single-byte encoding, transcoding all its cells to UTF-8
+        at once rather than calling a Python codec per cell."""
+        cdef:
+            const ColumnInfo *colinfo = &self.fileinfo.columns[col_idx]
+            size_t needed = n_rows * colinfo.len * UTF8_MAX_EXPANSION, i, row_idx
+            void *new_buf
+        if needed > self.transcode_buf_len:
+            new_buf = realloc(self.transcode_buf, needed)
+            if new_buf == NULL:
+                raise MemoryError()
+            self.transcode_buf = <uint8_t *>new_buf
+            self.transcode_buf_len = needed
+        if n_rows + 1 > self.transcode_offsets_len:
+            new_buf = realloc(self.transcode_offsets, (n_rows + 1) * sizeof(int64_t))
+            if new_buf == NULL:
+                raise MemoryError()
+            self.transcode_offsets = <int64_t *>new_buf
+            self.transcode_offsets_len = n_rows + 1
+        self.transcode_offsets[0] = 0
+        transcode_column_to_utf8(
+            self.codepage,
+            <Parser *>self.parser,
+            colinfo,
+            first_row,
+            n_rows,
+            stride,
+            # The fast space offsets are by row of the batch, and first_row need not be its first row
+            have_fast_space_offsets and batch_row_start == 0,
+            self.transcode_buf,
+            self.transcode_offsets,
+        )
+        arr = self.col_arrs_write[col_idx]
+        for i in range(n_rows):
+            row_idx = self.current_row + batch_row_start + i
+            if self.transcode_offsets[i + 1] > self.transcode_offsets[i]:
+                np_setitem[object](arr, row_idx, PyUnicode_DecodeUTF8(
+                    <const char *>&self.transcode_buf[self.transcode_offsets[i]],
+                    self.transcode_offsets[i + 1] - self.transcode_offsets[i],
+                    NULL,
+                ))
+            elif self.blank_as_nan:
+                np_setitem[object](arr, row_idx, np_nan)
+            else:
+                np_setitem[object](arr, row_idx, empty_string)
+        return True
 
-        for col_idx in range(self.fileinfo.column_count):
-            colinfo = &self.fileinfo.columns[col_idx]
-            if colinfo.format == column_format_raw:
-                self._on_cell_raw(buf, self.current_row, col_idx, colinfo)
-            elif colinfo.format == column_format_string:
-                self._on_cell_string(buf, self.current_row, col_idx, colinfo, have_fast_space_offsets)
+    cdef size_t _on_column_categorical(
+        self,
+        size_t col_idx,
+        const uint8_t *first_row,
+        size_t n_rows,
+        size_t stride,
+        bool have_fast_space_offsets,
+    ) except? SIZE_MAX:
+        """Dictionary encode a string column. Return the number of rows encoded; if it is less
+        than n_rows, the column has too many distinct values and falls back to plain strings."""
+        cdef:
+            StringMemo *memo = self.string_memos[col_idx]
+            size_t n_encoded, code, value_len
+            const uint8_t *value
+        n_encoded = string_memo_encode(
+            memo,
+            <Parser *>self.parser,
+            &self.fileinfo.columns[col_idx],
+            first_row,
+            n_rows,
+            stride,
+            have_fast_space_offsets,
+            self.blank_as_nan,
+            <int32_t *>PyArray_GETPTR1(self.col_arrs_write[col_idx], self.current_row),
+        )
+        categories = self.categories[col_idx]
+        for code in range(len(categories), string_memo_size(memo)):
+            value = string_memo_value(memo, code, &value_len)
+            if value_len > 0:
+                categories.append(decode_string(ConstBytestring(value, value_len), self.encoding, self.fallback_decoder))
+            else:
+                categories.append(empty_bytes if self.encoding == encoding_raw else empty_string)
+        if n_encoded < n_rows:
+            self._categorical_to_strings(col_idx, self.current_row + n_encoded)
+        return n_encoded
+
+    cdef _categorical_to_strings(self, size_t col_idx, size_t n_rows):
+        """Fall back to plain strings for a column, starting with its first n_rows rows."""
+        codes = self.col_arrs_read[col_idx][:n_rows]
+        values = np.empty(len(self.col_arrs_read[col_idx]), dtype="object")
+        values[:n_rows] = np.array(self.categories[col_idx] + [np_nan], dtype="object")[codes]
+        self.col_arrs_read[col_idx] = self.col_arrs_write[col_idx] = values
+        self.col_data[col_idx] = <uint8_t *>np.PyArray_DATA(values)
+        self.categories[col_idx] = None
+        self._free_string_memo(col_idx)
+
+    cdef bool _on_number_spans(self, const uint8_t *first_row, size_t n_rows, size_t stride) except False nogil:
+        cdef:
+            size_t span_idx
+            const ColumnSpan *span
+        for span_idx in range(self.fileinfo.span_count):
+            span = &self.fileinfo.spans[span_idx]
+            if span.format == column_format_raw or span.format == column_format_string:
+                continue
+            if span.format == column_format_double and span.column_len == 8 and not self.fileinfo.need_byteswap:
+                self._on_span_double(span, first_row, n_rows, stride)
             else:
-                self._on_cell_number(buf, self.current_row, col_idx, colinfo)
+                self._on_span_numbers(span, first_row, n_rows, stride)
+        return True
+
+    cdef inline void _on_span_double(
+        self,
+        const ColumnSpan *span,
+        const uint8_t *first_row,
+        size_t n_rows,
+        size_t stride,
+    ) noexcept nogil:
+        """Copy a span of native 8-byte doubles to the output arrays, without per-cell dispatch."""
+        cdef size_t span_col_idx
+        for span_col_idx in range(span.n_columns):
+            self.span_out[span_col_idx] = (
+                self.col_data[self.fileinfo.column_order[span.first_column + span_col_idx]] + 8 * self.current_row
+            )
+        transpose8(first_row + span.offset, n_rows, stride, span.n_columns, self.span_out)
 
-        self.current_row += 1
-        return self.current_row == len(self.col_arrs_write[0])
+    cdef inline bool _on_span_numbers(
+        self,
+        const ColumnSpan *span,
+        const uint8_t *first_row,
+        size_t n_rows,
+        size_t stride,
+    ) except False nogil:
+        """Decode a span of numbers of any length and endianness a column slice at a time."""
+        cdef:
+            size_t span_col_idx, col_idx, block_start, block_len, i
+            const uint8_t *src
+        for span_col_idx in range(span.n_columns):
+            col_idx = self.fileinfo.column_order[span.first_column + span_col_idx]
+            src = first_row + span.offset + span_col_idx * span.column_len
+            if span.format == column_format_double:
+                decimal2double_batch(
+                    src,
+                    n_rows,
+                    stride,
+                    span.column_len,
+                    self.fileinfo.is_little_endian,
+                    <double *>self.col_data[col_idx] + self.current_row,
+                )
+                continue
+            block_start = 0
+            while block_start < n_rows:
+                block_len = min(n_rows - block_start, DECODE_BLOCK_ROWS)
+                decimal2double_batch(
+                    src + block_start * stride,
+                    block_len,
+                    stride,
+                    span.column_len,
+                    self.fileinfo.is_little_endian,
+                    self.decode_buf,
+                )
+                for i in range(block_len):
+                    self._store_number(self.current_row + block_start + i, col_idx, span.format, self.decode_buf[i])
+                block_start += block_len
+        return True
 
     cdef inline bool _on_cell_raw(
         self,
@@ -363,86 +1237,85 @@ cdef class Context:
         size_t row_idx,
         size_t col_idx,
         const ColumnInfo *colinfo,
+        Encoding encoding,
         bool have_fast_space_offsets,
+        size_t batch_row_idx,
      ) except False:
         cdef:
             size_t str_len = colinfo.len
             object value
         if str_len > 0 and have_fast_space_offsets:
-            str_len = rstrip_whitespace_fast(<Parser *>self.parser, buf, colinfo)
+            str_len = rstrip_whitespace_fast(<Parser *>self.parser, buf, colinfo, batch_row_idx)
         if str_len > 0:
             str_len = rstrip_whitespace(&buf[colinfo.offset], str_len)
         if str_len > 0:
-            value = decode_string(
-                ConstBytestring(&buf[colinfo.offset], str_len),
-                self.encoding,
-                self.fallback_decoder,
-            )
+            if encoding == encoding_raw:
+                value = buf[colinfo.offset:colinfo.offset + str_len]
+            else:
+                value = decode_string_as(
+                    ConstBytestring(&buf[colinfo.offset], str_len),
+                    encoding,
+                    self.fallback_decoder,
+                )
         else:
             if self.blank_as_nan:
                 value = np_nan
-            elif self.encoding == encoding_raw:
+            elif encoding == encoding_raw:
                 value = empty_bytes
             else:
                 value = empty_string
         np_setitem[object](self.col_arrs_write[col_idx], row_idx, value)
         return True
 
-    cdef inline bool _on_cell_number(
+    cdef inline bool _store_number(
         self,
-        const uint8_t *buf,
         size_t row_idx,
         size_t col_idx,
-        const ColumnInfo *colinfo,
-    ) except False:
-        cdef:
-            float64_t value
-            ColumnFormat colfmt = colinfo.format
-
-        # Inline variant of most common path
-        if colfmt == column_format_double and colinfo.len == 8 and not self.fileinfo.need_byteswap:
-            memcpy(PyArray_GETPTR1(self.col_arrs_write[col_idx], row_idx), &buf[colinfo.offset], 8)
-            return True
-
-        if colinfo.len == 8 and not self.fileinfo.need_byteswap:
-            # Fast path
-            value = (<float64_t*>&buf[colinfo.offset])[0]
-        else:
-            decimal2double(&buf[colinfo.offset], colinfo.len, self.fileinfo.is_little_endian, &value)
-
+        ColumnFormat colfmt,
+        float64_t value,
+    ) except False nogil:
+        cdef uint8_t *data = self.col_data[col_idx]
         if isnan(value):
-            if column_format_is_floating(colfmt):
-                np_setitem[float64_t](self.col_arrs_write[col_idx], row_idx, value)
+            if colfmt == column_format_double:
+                (<float64_t *>data)[row_idx] = value
+            elif colfmt == column_format_float:
+                (<float32_t *>data)[row_idx] = <float32_t>value
             elif column_format_is_date_time(colfmt):
-                np_setitem[int64_t](self.col_arrs_write[col_idx], row_idx, NPY_MIN_INT64)
+                (<int64_t *>data)[row_idx] = NPY_MIN_INT64
             else:
-                raise ValueError("Unexpected NaN")
+                with gil:
+                    raise ValueError("Unexpected NaN")
             return True
 
         if column_format_is_date_time(colfmt):
-            np_setitem[int64_t](
-                self.col_arrs_write[col_idx],
-                row_idx,
-                <int64_t>value - 3653 * (1 if colfmt == column_format_date else 24 * 3600),
-            )
+            (<int64_t *>data)[row_idx] = <int64_t>value - 3653 * (1 if colfmt == column_format_date else 24 * 3600)
             return True
 
         if colfmt == column_format_double:
-            np_setitem[float64_t](self.col_arrs_write[col_idx], row_idx, value)
+            (<float64_t *>data)[row_idx] = value
         elif colfmt == column_format_float:
-            np_setitem[float32_t](self.col_arrs_write[col_idx], row_idx, <float32_t>value)
+            (<float32_t *>data)[row_idx] = <float32_t>value
         elif colfmt == column_format_bool:
-            np_setitem[bool](self.col_arrs_write[col_idx], row_idx, <bool>value)
+            (<bool *>data)[row_idx] = <bool>value
         elif colfmt == column_format_int8:
-            np_setitem[int8_t](self.col_arrs_write[col_idx], row_idx, <int8_t>value)
+            (<int8_t *>data)[row_idx] = <int8_t>value
         elif colfmt == column_format_int16:
-            np_setitem[int16_t](self.col_arrs_write[col_idx], row_idx, <int16_t>value)
+            (<int16_t *>data)[row_idx] = <int16_t>value
         elif colfmt == column_format_int32:
-            np_setitem[int32_t](self.col_arrs_write[col_idx], row_idx, <int32_t>value)
+            (<int32_t *>data)[row_idx] = <int32_t>value
         elif colfmt == column_format_int64:
-            np_setitem[int64_t](self.col_arrs_write[col_idx], row_idx, <int64_t>value)
+            (<int64_t *>data)[row_idx] = <int64_t>value
+        elif colfmt == column_format_uint8:
+            (<uint8_t *>data)[row_idx] = <uint8_t>value
+        elif colfmt == column_format_uint16:
+            (<uint16_t *>data)[row_idx] = <uint16_t>value
+        elif colfmt == column_format_uint32:
+            (<uint32_t *>data)[row_idx] = <uint32_t>value
+        elif colfmt == column_format_uint64:
+            (<uint64_t *>data)[row_idx] = <uint64_t>value
         else:
-            raise ParserError(f"Unexpected column format {colfmt}")
+            with gil:
+                raise ParserError(f"Unexpected column format {colfmt}")
         return True
 
     cdef reset_chunk(self):
@@ -454,11 +1327,128 @@ cdef class Context:
             self.get_current_chunk_arrays(),
         ))
 
+    cdef get_current_chunk_arrow(self):
+        return finish_arrow_batch(self.arrow_builder)
+
     cdef get_current_chunk_arrays(self):
-        if self.copy_arrays:
-            return [nd[:self.current_row] for nd in self.col_arrs_read]
-        else:
-            return [nd[:self.current_row].copy() for nd in self.col_arrs_read]
+        return self._finish_arrays(self._current_chunk_arrays(self.copy_arrays))
+
+    cdef list _current_chunk_arrays(self, bool copy):
+        arrays = [nd[:self.current_row] if nd is not None else None for nd in self.col_arrs_read]
+        if copy:
+            return [nd.copy() if nd is not None else None for nd in arrays]
+        # Hand out views. The next chunk is parsed into new arrays, so they are never
+        # overwritten, also if it is parsed while the consumer still uses this one.
+        self.arrays_handed_out = True
+        return arrays
+
+    cdef get_current_chunk_dataframe(self):
+        """The chunk as a pandas DataFrame, built around the blocks of _init_blocks()."""
+        import pandas as pd
+        cdef size_t n_rows = self.current_row
+        cdef bool infer_string = pandas_infers_strings(pd)
+        arrays = self._finish_arrays(self._current_chunk_arrays(False))
+        blocks = []
+        in_block = set()
+        for block, col_idxs in self.blocks:
+            values = block[:, :n_rows]
+            # infer_dtypes may have narrowed some of the columns into arrays of their own
+            intact = [i for i, col_idx in enumerate(col_idxs) if arrays[col_idx].dtype == block.dtype]
+            if len(intact) == len(col_idxs):
+                blocks.append((values, np.asarray(col_idxs, dtype=np.intp)))
+            else:
+                blocks.extend((values[i:i + 1], np.asarray([col_idxs[i]], dtype=np.intp)) for i in intact)
+            in_block.update(col_idxs[i] for i in intact)
+        for col_idx, arr in enumerate(arrays):
+            if col_idx not in in_block:
+                blocks.append((block_values(pd, arr, infer_string), np.asarray([col_idx], dtype=np.intp)))
+        df = dataframe_from_blocks(pd, blocks, pd.RangeIndex(n_rows), pd.Index(self.get_column_names()))
+        return df.copy() if self.copy_arrays else df
+
+    cdef list _finish_arrays(self, list arrays):
+        """Convert the arrays of a chunk to the dtypes asked for."""
+        if self.string_builder != NULL:
+            arrays = self._add_string_arrays(arrays)
+        if self.infer_dtypes:
+            arrays = self._narrow_arrays(arrays)
+        if self.string_memos != NULL:
+            arrays = self._make_categoricals(arrays)
+        return arrays
+
+    cdef _add_string_arrays(self, list arrays):
+        """String columns as pandas StringDtype("pyarrow") arrays, from the string builder."""
+        import pandas as pd
+        import pyarrow as pa
+        cdef size_t col_idx, i = 0
+        batch = pa.record_batch(finish_arrow_batch(self.string_builder))
+        for col_idx in range(self.fileinfo.column_count):
+            if self.fileinfo.columns[col_idx].format == column_format_string:
+                arrays[col_idx] = make_arrow_string_array(pd, pa, batch.column(i))
+                i += 1
+        return arrays
+
+    cdef _make_categoricals(self, list arrays):
+        """Codes to pandas.Categorical. Categories are the fixed ones, or those of all chunks
+        so far."""
+        import pandas as pd
+        cdef size_t col_idx
+        for col_idx in range(self.fileinfo.column_count):
+            if self.string_memos[col_idx] == NULL:
+                continue
+            dtype = self.categorical_dtypes[col_idx]
+            indexer = self.category_indexers[col_idx]
+            if indexer is not None:
+                if len(indexer) != len(self.categories[col_idx]) + 1:
+                    # The last entry maps missing values (-1) to themselves
+                    indexer = self.category_indexers[col_idx] = np.append(
+                        dtype.categories.get_indexer(self.categories[col_idx]), -1
+                    ).astype("int32")
+                codes = indexer[arrays[col_idx]]
+            else:
+                if dtype is None or len(dtype.categories) != len(self.categories[col_idx]):
+                    dtype = self.categorical_dtypes[col_idx] = pd.CategoricalDtype(self.categories[col_idx])
+                codes = arrays[col_idx].copy()
+            arrays[col_idx] = pd.Categorical.from_codes(codes, dtype=dtype)
+        return arrays
+
+    cdef _narrow_arrays(self, list arrays):
+        """Convert double columns to the narrowest lossless dtype. Only used for unchunked
+        parses; parse_file() chooses the dtypes of chunked parses up front, so that all chunks
+        agree (see _infer_column_formats())."""
+        cdef:
+            size_t col_idx
+            const double[::1] values
+        for col_idx in range(self.fileinfo.column_count):
+            if self.fileinfo.columns[col_idx].format != column_format_double:
+                continue
+            values = arrays[col_idx]
+            if values.shape[0] > 0:
+                number_stats_update(&self.number_stats[col_idx], &values[0], values.shape[0])
+            fmt = number_stats_narrowest_format(&self.number_stats[col_idx])
+            if fmt != column_format_double:
+                arrays[col_idx] = arrays[col_idx].astype(COLUMN_FORMAT_DTYPES[fmt])
+        return arrays
+
+    cdef get_metadata(self):
+        cdef:
+            const FileInfo *fileinfo = self.fileinfo
+            size_t col_idx
+        return {
+            "row_count": fileinfo.row_count,
+            "page_count": fileinfo.page_count,
+            "encoding": ENCODING_NAMES.get(fileinfo.encoding, fileinfo.encoding),
+            "is_32_bit": fileinfo.is_32_bit,
+            "is_little_endian": fileinfo.is_little_endian,
+            "columns": [
+                {
+                    "name": name,
+                    "format": COLUMN_FORMAT_NAMES[fileinfo.columns[col_idx].format],
+                    "length": fileinfo.columns[col_idx].len,
+                    "offset": fileinfo.columns[col_idx].offset,
+                }
+                for col_idx, name in enumerate(self.get_column_names())
+            ],
+        }
 
     cdef get_column_names(self):
         def _colname(i):
@@ -475,7 +1465,335 @@ class ParserError(Exception):
     pass
 
 
-def parse_file(filename: str | bytes | os.PathLike, fsize=None, use_mmap=True, **kwargs):
+# --- pandas blocks ---
+
+cdef bool pandas_infers_strings(pd):
+    try:
+        return pd.get_option("future.infer_string")
+    except KeyError:  # pandas < 2.1
+        return False
+
+
+cdef block_values(pd, arr, bool infer_string):
+    """Values of a pandas block of a single column. Converts them like pd.DataFrame() does."""
+    if not isinstance(arr, np.ndarray):
+        return arr
+    if arr.dtype == object and infer_string and pd.api.types.infer_dtype(arr, skipna=True) == "string":
+        return pd.array(arr, dtype="str")
+    if arr.dtype.kind == "M":
+        return pd.array(arr)
+    if arr.dtype.kind == "S":
+        arr = arr.astype(object)
+    return arr.reshape(1, -1)
+
+
+def _pandas_blocks_api(pd):
+    """How dataframe_from_blocks() builds DataFrames with this pandas version: "public"
+    (pandas.api.internals), "internals" (the pandas 1 and 2 internals it was tested
+    with) or "constructor" (pd.DataFrame(), which may copy)."""
+    try:
+        import pandas.api.internals
+    except ImportError:
+        pass
+    else:
+        if hasattr(pandas.api.internals, "create_dataframe_from_blocks"):
+            return "public"
+    if pd.__version__.split(".")[0] in {"1", "2"}:
+        return "internals"
+    return "constructor"
+
+
+cdef dataframe_from_blocks(pd, list blocks, index, columns):
+    """DataFrame of (values, column indices) blocks, without copying or consolidating them
+    where the pandas version allows it."""
+    api = _pandas_blocks_api(pd)
+    if api == "public":
+        from pandas.api.internals import create_dataframe_from_blocks
+        return create_dataframe_from_blocks(blocks, index=index, columns=columns)
+    if api == "constructor":
+        arrays = {}
+        for values, placement in blocks:
+            for i, col_idx in enumerate(placement):
+                arrays[col_idx] = values[i] if values.ndim == 2 else values
+        df = pd.DataFrame({col_idx: arrays[col_idx] for col_idx in sorted(arrays)}, index=index, copy=False)
+        df.columns = columns
+        return df
+    from pandas.core.dtypes.common import is_1d_only_ea_dtype
+    from pandas.core.internals import BlockManager
+    from pandas.core.internals.api import make_block
+    mgr = BlockManager(
+        [
+            make_block(
+                values if values.ndim == 2 or is_1d_only_ea_dtype(values.dtype) else values.reshape(1, -1),
+                placement=placement,
+                ndim=2,
+            )
+            for values, placement in blocks
+        ],
+        [columns, index],
+    )
+    return pd.DataFrame._from_mgr(mgr, mgr.axes) if hasattr(pd.DataFrame, "_from_mgr") else pd.DataFrame(mgr)
+
+
+# --- Arrow PyCapsule interface ---
+
+cdef ArrowBatchBuilder *make_arrow_batch_builder(const FileInfo *fileinfo, Encoding encoding, bool blank_as_null, bool strings_only, size_t capacity) except NULL:
+    cdef ArrowBatchBuilder *builder = <ArrowBatchBuilder *>malloc(arrow_batch_builder_struct_size())
+    if builder == NULL:
+        raise MemoryError()
+    try:
+        arrow_batch_builder_init(builder, fileinfo, encoding, blank_as_null, strings_only, capacity)
+    except:
+        free(builder)
+        raise
+    return builder
+
+cdef check_arrow_strings_are_utf8(const ArrowBatchBuilder *builder, Encoding encoding):
+    cdef:
+        ArrowSchema schema
+        int64_t i
+    arrow_batch_builder_export_schema(builder, &schema)
+    try:
+        for i in range(schema.n_children):
+            if schema.children[i].format != b"U":
+                raise NotImplementedError(
+                    f"Arrow strings are not supported for encoding {ENCODING_NAMES.get(encoding, encoding)!r}"
+                )
+    finally:
+        schema.release(&schema)
+
+cdef make_arrow_string_array(pd, pa, array):
+    try:
+        return pd.arrays.ArrowStringArray(array)
+    except (TypeError, ValueError):
+        # Older pandas only support pa.string()
+        return pd.arrays.ArrowStringArray(array.cast(pa.string()))
+
+cdef ArrowRecordBatch finish_arrow_batch(ArrowBatchBuilder *builder):
+    cdef ArrowRecordBatch batch = ArrowRecordBatch.__new__(ArrowRecordBatch)
+    arrow_batch_builder_export_schema(builder, &batch.schema)
+    arrow_batch_builder_finish(builder, &batch.array)
+    return batch
+
+cdef void _release_arrow_schema_capsule(object capsule):
+    cdef ArrowSchema *schema = <ArrowSchema *>PyCapsule_GetPointer(capsule, "arrow_schema")
+    if schema.release != NULL:
+        schema.release(schema)
+    free(schema)
+
+cdef void _release_arrow_array_capsule(object capsule):
+    cdef ArrowArray *array = <ArrowArray *>PyCapsule_GetPointer(capsule, "arrow_array")
+    if array.release != NULL:
+        array.release(array)
+    free(array)
+
+cdef void _release_arrow_array_stream_capsule(object capsule):
+    cdef ArrowArrayStream *stream = <ArrowArrayStream *>PyCapsule_GetPointer(capsule, "arrow_array_stream")
+    if stream.release != NULL:
+        stream.release(stream)
+    free(stream)
+
+cdef object _export_arrow_schema(const ArrowSchema *schema):
+    cdef ArrowSchema *copy = <ArrowSchema *>malloc(sizeof(ArrowSchema))
+    if copy == NULL:
+        raise MemoryError()
+    try:
+        arrow_schema_deep_copy(schema, copy)
+    except:
+        free(copy)
+        raise
+    return PyCapsule_New(copy, "arrow_schema", <PyCapsule_Destructor>_release_arrow_schema_capsule)
+
+
+cdef class ArrowRecordBatch:
+    """A chunk of rows as an Arrow record batch, eg. for pyarrow.record_batch(batch)
+    or polars.DataFrame(batch). Implements the Arrow PyCapsule interface; the data
+    can only be exported once, without copying."""
+    cdef:
+        ArrowSchema schema
+        ArrowArray array
+
+    def __dealloc__(self):
+        if self.schema.release != NULL:
+            self.schema.release(&self.schema)
+        if self.array.release != NULL:
+            self.array.release(&self.array)
+
+    @property
+    def num_rows(self):
+        return self.array.length
+
+    def __arrow_c_schema__(self):
+        return _export_arrow_schema(&self.schema)
+
+    def __arrow_c_array__(self, requested_schema=None):
+        cdef ArrowArray *array
+        if self.array.release == NULL:
+            raise ValueError("The record batch has already been exported")
+        schema_capsule = _export_arrow_schema(&self.schema)
+        array = <ArrowArray *>malloc(sizeof(ArrowArray))
+        if array == NULL:
+            raise MemoryError()
+        array[0] = self.array
+        self.array.release = NULL
+        return schema_capsule, PyCapsule_New(array, "arrow_array", <PyCapsule_Destructor>_release_arrow_array_capsule)
+
+
+cdef class ArrowRecordBatchStream:
+    """Record batches of a file, eg. for pyarrow.table(stream) or
+    duckdb.from_arrow(stream). Implements the Arrow PyCapsule stream interface;
+    the data can only be exported once."""
+    cdef list batches
+
+    def __init__(self, batches):
+        self.batches = list(batches)
+        if not self.batches:
+            raise ValueError("Need at least one batch for the schema")
+
+    def __arrow_c_schema__(self):
+        return (<ArrowRecordBatch>self.batches[0]).__arrow_c_schema__()
+
+    def __arrow_c_stream__(self, requested_schema=None):
+        cdef:
+            ArrowRecordBatch batch
+            ArrowArrayStream *stream
+            ArrowArray *arrays
+            ArrowSchema schema
+            size_t i
+        for batch in self.batches:
+            if batch.array.release == NULL:
+                raise ValueError("A record batch has already been exported")
+        stream = <ArrowArrayStream *>malloc(sizeof(ArrowArrayStream))
+        arrays = <ArrowArray *>malloc(len(self.batches) * sizeof(ArrowArray))
+        try:
+            if stream == NULL or arrays == NULL:
+                raise MemoryError()
+            arrow_schema_deep_copy(&(<ArrowRecordBatch>self.batches[0]).schema, &schema)
+            for i, batch in enumerate(self.batches):
+                arrays[i] = batch.array
+            try:
+                arrow_batch_stream_init(stream, &schema, arrays, len(self.batches))
+            except:
+                schema.release(&schema)
+                raise
+        except:
+            free(stream)
+            free(arrays)
+            raise
+        # Moved to the stream
+        for batch in self.batches:
+            batch.array.release = NULL
+        free(arrays)
+        return PyCapsule_New(stream, "arrow_array_stream", <PyCapsule_Destructor>_release_arrow_array_stream_capsule)
+
+
+# --- Row filters ---
+
+_ROW_FILTER_OPS = {
+    "<": row_filter_lt,
+    "<=": row_filter_le,
+    ">": row_filter_gt,
+    ">=": row_filter_ge,
+    "=": row_filter_eq,
+    "==": row_filter_eq,
+    "!=": row_filter_ne,
+}
+
+_SAS_EPOCH_DATE = datetime.date(1960, 1, 1)
+_SAS_EPOCH_DATETIME = datetime.datetime(1960, 1, 1)
+_SAS_EPOCH_DATETIME64 = np.datetime64("1960-01-01T00:00:00")
+
+
+def _to_sas_value(value):
+    """Convert a filter value to SAS units. Dates and datetimes become seconds since
+    1960-01-01; the parser converts them to days for date columns."""
+    if isinstance(value, datetime.datetime):
+        if value.tzinfo is not None:
+            raise ValueError(f"Timezone-aware filter values are not supported: {value!r}")
+        return (value - _SAS_EPOCH_DATETIME).total_seconds()
+    if isinstance(value, datetime.date):
+        return (value - _SAS_EPOCH_DATE).days * 86400.0
+    if isinstance(value, np.datetime64):
+        return (value - _SAS_EPOCH_DATETIME64) / np.timedelta64(1, "s")
+    return float(value)
+
+
+def _row_filter_term(name, op, *values):
+    """(column_name, op, value, value2, datetime_values) term of a comparison."""
+    is_datetime = [isinstance(v, (datetime.date, np.datetime64)) for v in values]
+    if any(is_datetime) != all(is_datetime):
+        raise ValueError(f"Filter on {name!r} mixes dates and numbers")
+    value, value2 = [_to_sas_value(v) for v in values] + [0] * (2 - len(values))
+    return (name, op, value, value2, any(is_datetime))
+
+
+def row_filter_to_postfix(filters):
+    """Convert filters in disjunctive normal form to a postfix list of
+    (column_name, op, value, value2, datetime_values) terms.
+
+    Like in pyarrow, 'filters' is a list of (column, op, value) tuples that are
+    combined with AND, or a list of such lists that are combined with OR.
+    Supported ops are <, <=, >, >=, ==, !=, in, not in, between (value is a
+    (low, high) tuple), is_null and not_null. '== None' and '!= None' are
+    equivalent to is_null and not_null.
+    """
+    if filters and isinstance(filters[0], tuple):
+        filters = [filters]
+    postfix = []
+    for conjunction_idx, conjunction in enumerate(filters):
+        if not conjunction:
+            raise ValueError("Empty conjunction in filters")
+        for term_idx, (name, op, value) in enumerate(conjunction):
+            if op in ("==", "=", "!=") and value is None:
+                op = "is_null" if op != "!=" else "not_null"
+            if op == "is_null":
+                postfix.append((name, row_filter_is_null, 0, 0, False))
+            elif op == "not_null":
+                postfix.append((name, row_filter_not_null, 0, 0, False))
+            elif op == "between":
+                low, high = value
+                postfix.append(_row_filter_term(name, row_filter_between, low, high))
+            elif op in ("in", "not in"):
+                values = list(value)
+                if not values:
+                    raise ValueError(f"Empty value list for {op!r} filter on {name!r}")
+                term_op = row_filter_eq if op == "in" else row_filter_ne
+                combine_op = row_filter_or if op == "in" else row_filter_and
+                for value_idx, v in enumerate(values):
+                    postfix.append(_row_filter_term(name, term_op, v))
+                    if value_idx > 0:
+                        postfix.append((None, combine_op, 0, 0, False))
+            elif op in _ROW_FILTER_OPS:
+                postfix.append(_row_filter_term(name, _ROW_FILTER_OPS[op], value))
+            else:
+                raise ValueError(f"Unsupported filter operator {op!r}")
+            if term_idx > 0:
+                postfix.append((None, row_filter_and, 0, 0, False))
+        if conjunction_idx > 0:
+            postfix.append((None, row_filter_or, 0, 0, False))
+    return postfix
+
+
+def parse_file(filename: str | bytes | os.PathLike, fsize=None, use_mmap=True, use_index=True, **kwargs):
+    if use_index and "page_index" not in kwargs:
+        try:
+            with open(index_filename_for(filename), "rb") as f:
+                kwargs["page_index"] = f.read()
+        except FileNotFoundError:
+            pass
+        except OSError as e:
+            warnings.warn(f"Ignoring unreadable page index: {e}")
+    if kwargs.get("infer_dtypes") and kwargs.get("chunksize"):
+        # All chunks must have the same dtypes, so choose them from a first pass over the file
+        kwargs["column_formats"] = {
+            **_infer_column_formats(filename, fsize, use_mmap, kwargs),
+            **(kwargs.get("column_formats") or {}),
+        }
+        kwargs["infer_dtypes"] = False
+    if kwargs.get("categorical") and kwargs.get("chunksize") and kwargs.get("categories") is None:
+        # Likewise, decide which columns are categorical and their categories up front
+        kwargs["categories"] = _infer_categories(filename, fsize, use_mmap, kwargs)
+        kwargs["categorical"] = False
     with open(filename, "rb") as f:
         fileno = f.fileno()
         if fsize is None:
@@ -484,13 +1802,125 @@ def parse_file(filename: str | bytes | os.PathLike, fsize=None, use_mmap=True, *
             with mmap.mmap(fileno, fsize, access=mmap.ACCESS_READ) as m:
                 yield from parse_mmap(m, **kwargs)
         else:
-            yield from parse_fileobj(f, fsize, **kwargs)
+            yield from parse_fd(fileno, fsize, **kwargs)
+
+
+# parse_file() arguments that affect which rows are read
+_ROW_SELECTION_KWARGS = (
+    "encoding",
+    "filters",
+    "max_rows",
+    "skip_rows",
+    "state",
+    "page_index",
+    "readahead_buffer_size",
+    "readahead_buffers",
+)
+
+
+def _infer_column_formats(filename, fsize, use_mmap, dict kwargs):
+    """Narrowest lossless formats of the double columns (that have no format in
+    kwargs["column_formats"]), over all rows that parse_file(filename, **kwargs) reads."""
+    cdef:
+        NumberStats *stats
+        const double[::1] values
+        size_t i
+    column_formats = kwargs.get("column_formats") or {}
+    usecols = kwargs.get("usecols")
+    metadata = read_metadata(filename, **{k: kwargs[k] for k in ["encoding"] if k in kwargs})
+    names = [
+        col["name"]
+        for col in metadata["columns"]
+        if col["format"] == "double"
+        and col["name"] not in column_formats
+        and (usecols is None or col["name"] in usecols)
+    ]
+    if not names:
+        return {}
+    stats = <NumberStats *>malloc(len(names) * sizeof(NumberStats))
+    if stats == NULL:
+        raise MemoryError()
+    try:
+        for i in range(len(names)):
+            number_stats_init(&stats[i])
+        chunks = parse_file(
+            filename,
+            fsize=fsize,
+            use_mmap=use_mmap,
+            use_index=False,
+            usecols=names,
+            chunksize=kwargs["chunksize"],
+            **{k: kwargs[k] for k in _ROW_SELECTION_KWARGS if k in kwargs},
+        )
+        for chunk in chunks:
+            for i, name in enumerate(names):
+                values = chunk[name]
+                if values.shape[0] > 0:
+                    number_stats_update(&stats[i], &values[0], values.shape[0])
+        return {
+            name: COLUMN_FORMAT_NAMES[number_stats_narrowest_format(&stats[i])]
+            for i, name in enumerate(names)
+        }
+    finally:
+        free(stats)
+
+
+def _infer_categories(filename, fsize, use_mmap, dict kwargs):
+    """Categories of the string columns with at most kwargs["max_categories"] distinct
+    values, over all rows that parse_file(filename, **kwargs) reads."""
+    import pandas as pd
+    usecols = kwargs.get("usecols")
+    metadata = read_metadata(filename, **{k: kwargs[k] for k in ["encoding"] if k in kwargs})
+    names = [
+        col["name"]
+        for col in metadata["columns"]
+        if col["format"] == "string" and (usecols is None or col["name"] in usecols)
+    ]
+    if not names:
+        return {}
+    chunks = parse_file(
+        filename,
+        fsize=fsize,
+        use_mmap=use_mmap,
+        use_index=False,
+        usecols=names,
+        chunksize=kwargs["chunksize"],
+        categorical=True,
+        categories={},
+        **{k: kwargs[k] for k in ["max_categories", "blank_as_nan"] if k in kwargs},
+        **{k: kwargs[k] for k in _ROW_SELECTION_KWARGS if k in kwargs},
+    )
+    last_chunk = None
+    for last_chunk in chunks:
+        pass
+    if last_chunk is None:
+        return {name: [] for name in names}
+    # The categories of a chunk are those of all chunks so far. Columns that exceeded
+    # max_categories are strings by then.
+    return {
+        name: list(values.categories)
+        for name, values in last_chunk.items()
+        if isinstance(values, pd.Categorical)
+    }
 
 
 def parse_mmap(m: mmap.mmap, **kwargs):
     return parse_buffer_iter(iter([m]), filesize_override=m.size(), **kwargs)
 
 
+def parse_fd(int fd, fsize, readahead_buffer_size=8 * 1024**2, readahead_buffers=4, **kwargs):
+    """Parse from a file descriptor using pread() with a readahead thread, without
+    going through Python for I/O. The fd must stay open while parsing."""
+    return parse_buffer_iter(
+        None,
+        filesize_override=fsize,
+        fd=fd,
+        readahead_buffer_size=readahead_buffer_size,
+        readahead_buffers=readahead_buffers,
+        **kwargs,
+    )
+
+
 def parse_fileobj(f, fsize=None, buffer_size=1024**3, **kwargs):
     def _chunks():
         bytes_read = 0
@@ -502,36 +1932,213 @@ def parse_fileobj(f, fsize=None, buffer_size=1024**3, **kwargs):
     return parse_buffer_iter(_chunks(), filesize_override=fsize, **kwargs)
 
 
+def index_filename_for(filename: str | bytes | os.PathLike):
+    """Default sidecar page index filename: <filename>.idx"""
+    return os.fsdecode(filename) + ".idx"
+
+
+def build_index(filename: str | bytes | os.PathLike, index_filename=None):
+    """Write a page index for a SAS7BDAT file, used by parse_file() to skip
+    page header decoding and to seek to rows in O(log pages).
+
+    Reads only page headers and subheader pointers. Returns the index filename.
+    """
+    cdef:
+        Parser *parser
+        size_t index_len
+        bytearray index
+    if index_filename is None:
+        index_filename = index_filename_for(filename)
+    with open(filename, "rb") as f:
+        with mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ) as m:
+            ctx = Context(iter([m]), filesize_override=m.size(), metadata_only=True)
+            parser = <Parser *>malloc(parser_struct_size())
+            ctx.parser = parser
+            try:
+                parser_init(parser, &ctx.config)
+                index_len = parser_serialize_page_index(parser, NULL, 0)
+                index = bytearray(index_len)
+                parser_serialize_page_index(parser, index, index_len)
+            finally:
+                parser_deinit(parser)
+                free(parser)
+                del ctx
+    # Write atomically so that concurrent readers never see a partial index
+    tmp_filename = f"{index_filename}.{os.getpid()}.tmp"
+    with open(tmp_filename, "wb") as f:
+        f.write(index)
+    os.replace(tmp_filename, index_filename)
+    return index_filename
+
+
+def read_arrow(filename: str | bytes | os.PathLike, **kwargs):
+    """Read a SAS7BDAT file into Arrow record batches of 'chunksize' rows, without
+    creating Python objects for the values. Returns an ArrowRecordBatchStream, eg.
+    for pyarrow.table(read_arrow(filename)). Takes the same arguments as parse_file().
+    """
+    return ArrowRecordBatchStream(parse_file(filename, arrow=True, **kwargs))
+
+
+def read_metadata(filename: str | bytes | os.PathLike, **kwargs):
+    """Read only the metadata of a SAS7BDAT file.
+
+    Returns a dict with the row and page counts, encoding and columns. "state"
+    is a serialized parser state that can be passed to parse_*(state=...) to
+    parse the file without reading its metadata again.
+    """
+    cdef:
+        Parser *parser
+        size_t state_len
+        bytearray state
+    with open(filename, "rb") as f:
+        with mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ) as m:
+            ctx = Context(iter([m]), filesize_override=m.size(), metadata_only=True, **kwargs)
+            parser = <Parser *>malloc(parser_struct_size())
+            ctx.parser = parser
+            try:
+                parser_init(parser, &ctx.config)
+                metadata = ctx.get_metadata()
+                state_len = parser_serialize_state(parser, NULL, 0)
+                state = bytearray(state_len)
+                parser_serialize_state(parser, state, state_len)
+                metadata["state"] = bytes(state)
+            finally:
+                parser_deinit(parser)
+                free(parser)
+                # Release buffer references before the mmap is closed
+                del ctx
+    return metadata
+
+
 def parse_buffer_iter(
     buffer_iter,
     *,
     size_t max_rows=SIZE_MAX,
+    size_t skip_rows=0,
     chunksize=None,
     filesize_override=None,
+    const uint8_t[:] state=None,
+    const uint8_t[:] page_index=None,
+    size_t prefetch_chunks=0,
     **kwargs,
 ):
+    """If prefetch_chunks > 0, parse in a background thread, up to prefetch_chunks chunks
+    ahead of the consumer. Parsing holds the GIL only to create Python objects, so it
+    overlaps with what the consumer does with the previous chunks."""
     cdef:
-        Parser *parser = <Parser *>malloc(parser_struct_size())
-        size_t retval = 1
-        size_t chunk_idx = 0
-    ctx = Context(buffer_iter, **kwargs, chunksize=chunksize, filesize_override=filesize_override)
+        Parser *parser
+    if kwargs.get("infer_dtypes") and chunksize:
+        raise ValueError("infer_dtypes with chunksize needs two passes over the file, use parse_file()")
+    if kwargs.get("categorical") and chunksize and kwargs.get("categories") is None:
+        raise ValueError("categorical with chunksize needs two passes over the file, use parse_file()")
+    parser = <Parser *>malloc(parser_struct_size())
+    ctx = Context(
+        buffer_iter, **kwargs, chunksize=chunksize, max_rows=max_rows, filesize_override=filesize_override
+    )
     ctx.parser = parser
     # TODO(ref) move into context and rename context -> parser?
-    parser_init(parser, &ctx.config)
+    if state is not None:
+        parser_init_from_state(parser, &ctx.config, &state[0], len(state))
+    else:
+        parser_init(parser, &ctx.config)
     #     raise ParserError(f"Error initializing parser: {last_error()}")
     try:
-        while retval:
-            retval = parse(parser)
-            # raise ParserError(f"Error parsing chunk {chunk_idx}: {last_error()}")
-            if max_rows != SIZE_MAX:
-                # TODO: properly implement max_rows
-                yield {c: d[:max_rows] for c, d in ctx.get_current_chunk_dict().items()}
-                break
-            if ctx.current_row:
-                yield ctx.get_current_chunk_dict()
-            ctx.reset_chunk()
-            chunk_idx += 1
+        raise_callback_error()
+        if page_index is not None:
+            # A bad page index only costs speed, so parse sequentially instead
+            try:
+                if len(page_index) == 0:
+                    raise ValueError("Empty page index")
+                loaded = parser_load_page_index(parser, &page_index[0], len(page_index))
+            except ValueError as e:
+                warnings.warn(f"Ignoring invalid page index: {e}")
+            else:
+                if not loaded:
+                    warnings.warn("Ignoring page index that was written for a different file")
+        chunks = _parse_chunks(ctx, skip_rows)
+        if prefetch_chunks:
+            yield from _prefetch(chunks, prefetch_chunks)
+        else:
+            yield from chunks
     finally:
         # TODO(ref): should use with statement for cleanup
         parser_deinit(parser)
         free(parser)
+
+
+def _parse_chunks(Context ctx, size_t skip_rows):
+    cdef:
+        Parser *parser = <Parser *>ctx.parser
+        bool retval = True
+        size_t chunk_idx = 0
+    if skip_rows:
+        with nogil:
+            retval = parser_seek_row(parser, skip_rows)
+    # Parsing stops at max_rows, so that nothing is read (or prefetched) past it
+    while retval and ctx.rows_left > 0:
+        with nogil:
+            retval = parse(parser)
+        # raise ParserError(f"Error parsing chunk {chunk_idx}: {last_error()}")
+        if ctx.current_row:
+            if ctx.arrow:
+                yield ctx.get_current_chunk_arrow()
+            elif ctx.dataframe:
+                yield ctx.get_current_chunk_dataframe()
+            else:
+                yield ctx.get_current_chunk_dict()
+            chunk_idx += 1
+        ctx.reset_chunk()
+    if ctx.arrow_builder != NULL and chunk_idx == 0:
+        # Yield an empty batch so that there is a schema
+        yield ctx.get_current_chunk_arrow()
+
+
+_PREFETCH_END = object()
+
+
+def _prefetch(chunks, size_t n_chunks):
+    """Run the 'chunks' generator in a background thread, up to n_chunks chunks ahead of the
+    consumer. Its exceptions are re-raised in the consumer, also those raised after the
+    consumer stopped early (from close())."""
+    import queue
+    import threading
+
+    q = queue.Queue(maxsize=n_chunks)
+    stop = threading.Event()
+
+    def produce():
+        try:
+            try:
+                for chunk in chunks:
+                    q.put((chunk, None))
+                    if stop.is_set():
+                        return
+            finally:
+                chunks.close()
+            q.put((_PREFETCH_END, None))
+        except BaseException as e:
+            q.put((None, e))
+
+    thread = threading.Thread(target=produce, name="sas7bdat-prefetch", daemon=True)
+    thread.start()
+    error = None
+    try:
+        while True:
+            chunk, exc = q.get()
+            if exc is not None:
+                raise exc
+            if chunk is _PREFETCH_END:
+                return
+            yield chunk
+    finally:
+        # The parser must not be used after we return. Unblock the producer until it stops.
+        stop.set()
+        while thread.is_alive() or not q.empty():
+            try:
+                chunk, exc = q.get(timeout=0.01)
+            except queue.Empty:
+                continue
+            error = error or exc
+        thread.join()
+        if error is not None:
+            raise error
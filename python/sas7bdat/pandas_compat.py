@@ -24,7 +24,7 @@ def read_sas(
     if iterator and not chunksize:
         chunksize = 1
 
-    kwargs = {"chunksize": chunksize, "copy_arrays": False}
+    kwargs = {"chunksize": chunksize, "dataframe": True, "copy_arrays": False}
     handles = pd_io_common.get_handle(
         filepath_or_buffer,
         mode="rb",
@@ -47,11 +47,8 @@ def read_sas(
 
 def _df_chunks(sas7bdat_iterator, index):
     pos = 0
-    for data in sas7bdat_iterator:
-        data_len = len(next(iter(data.values())))
-        yield pd.DataFrame(
-            data,
-            pd.RangeIndex(pos, pos + data_len) if index is None else index,
-            copy=True,
-        )
-        pos += data_len
+    for df in sas7bdat_iterator:
+        # The chunks are DataFrames of arrays of their own, so only set the index
+        df.index = pd.RangeIndex(pos, pos + len(df)) if index is None else index
+        yield df
+        pos += len(df)
@@ -19,13 +19,14 @@ CFLAGS = [
     "-Wno-missing-field-initializers",
     "-Wno-unused-const-variable",
     "-Wno-unused-function",
+    "-pthread",
 ]
 DEBUG = os.getenv("SAS7BDAT_DEBUG")
 if DEBUG:
     CFLAGS += ["-O2", "-g"]
 if os.getenv("SAS7BDAT_COMPILE_NATIVE"):
     CFLAGS += ["-mcpu=native"]
-LDFLAGS = [flag for flag in CFLAGS if flag.startswith("-f")]
+LDFLAGS = [flag for flag in CFLAGS if flag.startswith("-f") or flag == "-pthread"]
 
 setup(
     name="sas7bdat",
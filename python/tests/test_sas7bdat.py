@@ -0,0 +1,531 @@
+import datetime
+import io
+import os
+import shutil
+import struct
+import subprocess
+import threading
+from pathlib import Path
+
+import numpy as np
+import pandas as pd
+import pytest
+
+import sas7bdat._sas7bdat
+
+TEST_FILE = Path(__file__).parent / "pandas_test1.sas7bdat"
+
+
+def _read(**kwargs):
+    return _read_file(TEST_FILE, **kwargs)
+
+
+def _read_file(filename, **kwargs):
+    chunks = sas7bdat._sas7bdat.parse_file(filename, **kwargs)
+    return pd.concat(pd.DataFrame(chunk) for chunk in chunks).reset_index(drop=True)
+
+
+@pytest.mark.parametrize("skip_rows", [1, 5, 9])
+def test_skip_rows(skip_rows):
+    pd_df = pd.read_sas(TEST_FILE, encoding="ascii")
+    pd_df = pd_df.iloc[skip_rows:].reset_index(drop=True)
+    pd.testing.assert_frame_equal(_read(skip_rows=skip_rows), pd_df)
+
+
+def test_skip_rows_past_end():
+    assert list(sas7bdat._sas7bdat.parse_file(TEST_FILE, skip_rows=10)) == []
+
+
+@pytest.mark.parametrize("usecols", [["Column1"], ["Column100", "Column2", "Column3"]])
+def test_usecols(usecols):
+    pd_df = pd.read_sas(TEST_FILE, encoding="ascii")
+    pd_df = pd_df[[col for col in pd_df.columns if col in usecols]]
+    pd.testing.assert_frame_equal(_read(usecols=usecols), pd_df)
+
+
+def test_usecols_unknown_column():
+    with pytest.raises(ValueError, match="Unknown column"):
+        _read(usecols=["Column1", "Column0"])
+
+
+@pytest.mark.parametrize(
+    "filters,query",
+    [
+        ([("Column1", ">", 0.3)], "Column1 > 0.3"),
+        ([("Column1", "==", None)], "Column1 != Column1"),
+        (
+            [("Column4", ">=", datetime.date(1975, 1, 1)), ("Column3", "<", 50)],
+            "Column4 >= '1975-01-01' and Column3 < 50",
+        ),
+        (
+            [[("Column1", "<", 0.2)], [("Column3", "between", (30, 50))]],
+            "Column1 < 0.2 or 30 <= Column3 <= 50",
+        ),
+        ([("Column3", "in", [84, 15, 33])], "Column3 in [84, 15, 33]"),
+    ],
+)
+def test_filters(filters, query):
+    pd_df = pd.read_sas(TEST_FILE, encoding="ascii")
+    pd_df = pd_df.query(query).reset_index(drop=True)
+    pd.testing.assert_frame_equal(_read(filters=filters), pd_df)
+
+
+@pytest.mark.parametrize(
+    "column_format,op,value",
+    [
+        (None, ">=", datetime.date(1975, 1, 1)),
+        (None, ">=", datetime.datetime(1975, 1, 1, 12)),
+        (None, ">=", pd.Timestamp("1975-01-01")),
+        (None, ">=", np.datetime64("1975-01-01")),
+        # Column4 as seconds, ie. all values are before 1960-01-02
+        ("datetime", "<", datetime.date(1960, 1, 2)),
+        ("datetime", ">=", pd.Timestamp("1960-01-01 01:00")),
+        ("datetime", ">=", np.datetime64("1960-01-01T01:00")),
+    ],
+)
+def test_filters_dates(column_format, op, value):
+    # Dates are compared in days with date columns and in seconds with datetime columns
+    kwargs = {"column_formats": {"Column4": column_format}} if column_format else {}
+    df = _read(**kwargs)
+    threshold = pd.Timestamp(value)
+    expected = df.query(f"Column4 {op} @threshold").reset_index(drop=True)
+    pd.testing.assert_frame_equal(_read(filters=[("Column4", op, value)], **kwargs), expected)
+
+
+def test_filters_invalid_dates():
+    with pytest.raises(ValueError, match="Timezone-aware"):
+        _read(filters=[("Column4", ">=", pd.Timestamp("1975-01-01", tz="UTC"))])
+    with pytest.raises(ValueError, match="date or datetime column"):
+        _read(filters=[("Column1", ">=", datetime.date(1975, 1, 1))])
+    with pytest.raises(ValueError, match="mixes dates and numbers"):
+        _read(filters=[("Column4", "between", (datetime.date(1975, 1, 1), 10000))])
+
+
+def test_read_metadata():
+    pd_df = pd.read_sas(TEST_FILE, encoding="ascii")
+    metadata = sas7bdat._sas7bdat.read_metadata(TEST_FILE)
+    assert metadata["row_count"] == len(pd_df)
+    assert [col["name"] for col in metadata["columns"]] == list(pd_df.columns)
+    assert metadata["columns"][3]["format"] == "date"
+
+
+@pytest.mark.parametrize("kwargs", [{}, {"skip_rows": 3, "usecols": ["Column2", "Column4"]}])
+def test_parse_from_state(kwargs):
+    state = sas7bdat._sas7bdat.read_metadata(TEST_FILE)["state"]
+    pd.testing.assert_frame_equal(_read(state=state, **kwargs), _read(**kwargs))
+
+
+def test_parse_from_stale_state(tmp_path):
+    state = sas7bdat._sas7bdat.read_metadata(TEST_FILE)["state"]
+    test_file = tmp_path / TEST_FILE.name
+    data = bytearray(TEST_FILE.read_bytes())
+    # Change the file's modification date
+    data[172] ^= 1
+    test_file.write_bytes(data)
+    with pytest.raises(ValueError, match="different file"):
+        list(sas7bdat._sas7bdat.parse_file(test_file, state=state))
+
+
+@pytest.mark.parametrize(
+    "offset,value",
+    [
+        # Length of Column1, which is numeric
+        (97, struct.pack("<I", 9)),
+        # first_data_page
+        (69, struct.pack("<Q", 2**40)),
+        # first_data_subheader
+        (77, struct.pack("<Q", 2**20)),
+    ],
+)
+def test_parse_from_invalid_state(offset, value):
+    state = bytearray(sas7bdat._sas7bdat.read_metadata(TEST_FILE)["state"])
+    state[offset : offset + len(value)] = value
+    with pytest.raises(ValueError, match="Invalid parser state"):
+        list(sas7bdat._sas7bdat.parse_file(TEST_FILE, state=bytes(state)))
+
+
+def test_build_index(tmp_path):
+    test_file = tmp_path / TEST_FILE.name
+    test_file.write_bytes(TEST_FILE.read_bytes())
+    index_file = sas7bdat._sas7bdat.build_index(test_file)
+    assert index_file == f"{test_file}.idx"
+    for skip_rows in [0, 4]:
+        chunks = sas7bdat._sas7bdat.parse_file(test_file, skip_rows=skip_rows)
+        df = pd.concat(pd.DataFrame(chunk) for chunk in chunks).reset_index(drop=True)
+        pd.testing.assert_frame_equal(df, _read(skip_rows=skip_rows))
+
+
+def test_stale_index(tmp_path):
+    test_file = tmp_path / TEST_FILE.name
+    test_file.write_bytes(TEST_FILE.read_bytes())
+    index = Path(sas7bdat._sas7bdat.build_index(test_file)).read_bytes()
+    # Change the file's modification date
+    data = bytearray(TEST_FILE.read_bytes())
+    data[172] ^= 1
+    test_file.write_bytes(data)
+    with pytest.warns(UserWarning, match="different file"):
+        list(sas7bdat._sas7bdat.parse_file(test_file, page_index=index))
+
+
+@pytest.mark.parametrize(
+    "corrupt",
+    [
+        lambda index: b"",
+        lambda index: b"NOTANINDEX" + index[10:],
+        lambda index: index[:-1],
+        lambda index: index + b"\0",
+    ],
+)
+def test_corrupt_index(tmp_path, corrupt):
+    test_file = tmp_path / TEST_FILE.name
+    test_file.write_bytes(TEST_FILE.read_bytes())
+    index_file = Path(sas7bdat._sas7bdat.build_index(test_file))
+    index_file.write_bytes(corrupt(index_file.read_bytes()))
+    with pytest.warns(UserWarning, match="invalid page index"):
+        df = _read_file(test_file, skip_rows=4)
+    pd.testing.assert_frame_equal(df, _read(skip_rows=4))
+
+
+def test_unreadable_index(tmp_path):
+    test_file = tmp_path / TEST_FILE.name
+    test_file.write_bytes(TEST_FILE.read_bytes())
+    # A directory can't be read as a file
+    Path(sas7bdat._sas7bdat.index_filename_for(test_file)).mkdir()
+    with pytest.warns(UserWarning, match="unreadable page index"):
+        df = _read_file(test_file)
+    pd.testing.assert_frame_equal(df, _read())
+
+
+@pytest.mark.parametrize("readahead_buffer_size", [4096, 100_000, 8 * 1024**2])
+@pytest.mark.parametrize("skip_rows", [0, 4])
+def test_parse_file_native_reader(readahead_buffer_size, skip_rows):
+    df = _read(
+        use_mmap=False,
+        readahead_buffer_size=readahead_buffer_size,
+        readahead_buffers=2,
+        skip_rows=skip_rows,
+    )
+    pd.testing.assert_frame_equal(df, _read(skip_rows=skip_rows))
+
+
+@pytest.mark.parametrize("readahead_buffer_size", [4096, 100_000, 8 * 1024**2])
+def test_parse_file_native_reader_truncated(readahead_buffer_size):
+    # Pretend that the file has another page
+    fsize = TEST_FILE.stat().st_size + 65536
+    with pytest.raises(RuntimeError, match="truncated"):
+        _read(use_mmap=False, fsize=fsize, readahead_buffer_size=readahead_buffer_size)
+
+
+@pytest.mark.parametrize("chunksize", [None, 3, 5])
+@pytest.mark.parametrize("max_rows", [0, 4, 5, 100])
+@pytest.mark.parametrize("kwargs", [{}, {"prefetch_chunks": 2}, {"dataframe": True}])
+def test_max_rows(chunksize, max_rows, kwargs):
+    chunks = list(
+        sas7bdat._sas7bdat.parse_file(
+            TEST_FILE, skip_rows=1, max_rows=max_rows, chunksize=chunksize, **kwargs
+        )
+    )
+    if max_rows == 0:
+        assert chunks == []
+        return
+    dfs = [pd.DataFrame(chunk) for chunk in chunks]
+    assert all(len(df) <= (chunksize or max_rows) for df in dfs)
+    df = pd.concat(dfs).reset_index(drop=True)
+    expected = _read(skip_rows=1).iloc[:max_rows]
+    # A chunk of only missing strings may get another string dtype than the full column
+    pd.testing.assert_frame_equal(df.astype(expected.dtypes), expected)
+
+
+@pytest.mark.parametrize("chunksize", [None, 3])
+def test_max_rows_arrow(chunksize):
+    pa = pytest.importorskip("pyarrow")
+    table = pa.table(sas7bdat._sas7bdat.read_arrow(TEST_FILE, max_rows=5, chunksize=chunksize))
+    assert table.num_rows == 5
+
+
+def test_truncated_numbers(tmp_path):
+    # Shorten some numeric columns (LENGTH 3-7) in the column attributes subheader
+    data = bytearray(TEST_FILE.read_bytes())
+    subheader_offset = data.find(b"\xfc\xff\xff\xff")
+    for col_idx, length in [(0, 5), (2, 4), (4, 3), (6, 7), (7, 6)]:
+        struct.pack_into("<I", data, subheader_offset + 16 + 12 * col_idx, length)
+    test_file = tmp_path / TEST_FILE.name
+    test_file.write_bytes(data)
+    pd_df = pd.read_sas(test_file, encoding="ascii")
+    df = pd.DataFrame(next(sas7bdat._sas7bdat.parse_file(test_file)))
+    pd.testing.assert_frame_equal(df, pd_df)
+
+
+@pytest.mark.parametrize("chunksize", [None, 3])
+def test_column_formats(chunksize):
+    formats = {"Column3": "float", "Column20": "int16", "Column23": "uint8"}
+    df = _read(column_formats=formats, chunksize=chunksize, copy_arrays=False)
+    expected = _read().astype({"Column3": "float32", "Column20": "int16", "Column23": "uint8"})
+    assert df["Column3"].isna().any()
+    pd.testing.assert_frame_equal(df, expected)
+
+
+@pytest.mark.parametrize("chunksize", [None, 2])
+def test_infer_dtypes(chunksize):
+    chunks = [
+        pd.DataFrame(chunk)
+        for chunk in sas7bdat._sas7bdat.parse_file(TEST_FILE, infer_dtypes=True, chunksize=chunksize)
+    ]
+    # Every chunk has the dtypes that fit the whole column
+    for chunk in chunks:
+        pd.testing.assert_series_equal(
+            chunk.select_dtypes("number").dtypes, chunks[0].select_dtypes("number").dtypes
+        )
+    df = pd.concat(chunks).reset_index(drop=True)
+    assert df["Column3"].dtype == "float32"  # Has missing values, but not in the first chunk
+    assert df["Column20"].dtype == "int16"
+    assert df["Column23"].dtype == "int8"
+    pd.testing.assert_frame_equal(df, _read().astype(df.dtypes))
+
+
+def test_infer_dtypes_chunked_needs_file():
+    with TEST_FILE.open("rb") as f, pytest.raises(ValueError, match="parse_file"):
+        next(sas7bdat._sas7bdat.parse_fileobj(f, infer_dtypes=True, chunksize=3))
+
+
+@pytest.mark.parametrize("chunksize", [None, 3])
+def test_read_arrow(chunksize):
+    pa = pytest.importorskip("pyarrow")
+    table = pa.table(sas7bdat._sas7bdat.read_arrow(TEST_FILE, chunksize=chunksize))
+    assert table.schema.field("Column2").type == pa.large_string()
+    assert table.schema.field("Column4").type == pa.date32()
+    arrow_df = table.to_pandas()
+    for col in arrow_df.columns:
+        if table.schema.field(col).type == pa.date32():
+            arrow_df[col] = pd.to_datetime(arrow_df[col])
+        elif table.schema.field(col).type == pa.large_string():
+            arrow_df[col] = arrow_df[col].fillna(float("nan"))
+    pd.testing.assert_frame_equal(arrow_df, _read(), check_dtype=False)
+
+
+def test_read_arrow_export_once():
+    pa = pytest.importorskip("pyarrow")
+    (batch,) = sas7bdat._sas7bdat.parse_file(TEST_FILE, arrow=True)
+    assert pa.record_batch(batch).num_rows == 10
+    with pytest.raises(ValueError, match="already been exported"):
+        pa.record_batch(batch)
+
+
+@pytest.fixture(scope="module")
+def sas2arrow(tmp_path_factory):
+    source = Path(__file__).parents[2] / "sas2arrow.cpp"
+    cxx = os.environ.get("CXX", "c++")
+    if not source.exists() or shutil.which(cxx) is None:
+        pytest.skip("Needs the sas2arrow source and a C++ compiler")
+    exe = tmp_path_factory.mktemp("sas2arrow") / "sas2arrow"
+    subprocess.run([cxx, "-O1", "-std=c++20", "-pthread", source, "-o", exe], check=True)
+    return exe
+
+
+@pytest.mark.parametrize("batch_rows", [None, 3])
+def test_sas2arrow(tmp_path, sas2arrow, batch_rows):
+    pa = pytest.importorskip("pyarrow")
+    import pyarrow.ipc
+
+    out = tmp_path / "out.arrow"
+    subprocess.run(
+        [sas2arrow, TEST_FILE, out, *([str(batch_rows)] if batch_rows else [])], check=True
+    )
+    with pa.ipc.open_file(out) as reader:
+        assert reader.num_record_batches == (4 if batch_rows else 1)
+        table = reader.read_all()
+    table.validate(full=True)
+    assert table.equals(pa.table(sas7bdat._sas7bdat.read_arrow(TEST_FILE)))
+
+
+@pytest.mark.parametrize("chunksize", [None, 3])
+@pytest.mark.parametrize("max_categories", [2**16, 2])
+def test_categorical(chunksize, max_categories):
+    chunks = list(
+        sas7bdat._sas7bdat.parse_file(
+            TEST_FILE,
+            chunksize=chunksize,
+            categorical=True,
+            max_categories=max_categories,
+        )
+    )
+    # One dtype per column for all chunks
+    for chunk in chunks:
+        assert {col: values.dtype for col, values in chunk.items()} == {
+            col: values.dtype for col, values in chunks[0].items()
+        }
+    if max_categories > 2:
+        assert isinstance(chunks[0]["Column2"].dtype, pd.CategoricalDtype)
+    else:
+        # Too many distinct values
+        assert chunks[0]["Column2"].dtype == object
+    df = pd.concat(pd.DataFrame(chunk) for chunk in chunks).reset_index(drop=True)
+    if chunksize:
+        pd.testing.assert_frame_equal(df, _read(categorical=True, max_categories=max_categories))
+    expected = _read()
+    pd.testing.assert_frame_equal(df.astype(expected.dtypes), expected)
+
+
+@pytest.mark.parametrize("chunksize", [None, 3])
+def test_categories(chunksize):
+    df = _read(chunksize=chunksize, categories={"Column2": ["dog", "pear"]})
+    assert list(df["Column2"].cat.categories) == ["dog", "pear"]
+    expected = _read()["Column2"]
+    expected = expected.where(expected.isin(["dog", "pear"]))
+    pd.testing.assert_series_equal(df["Column2"].astype(expected.dtype), expected)
+    with pytest.raises(ValueError, match="Unknown string columns"):
+        _read(categories={"Column1": ["dog"]})
+
+
+def test_categorical_chunked_needs_file():
+    with TEST_FILE.open("rb") as f, pytest.raises(ValueError, match="parse_file"):
+        next(sas7bdat._sas7bdat.parse_fileobj(f, categorical=True, chunksize=3))
+
+
+@pytest.mark.parametrize("chunksize", [None, 3])
+def test_string_storage_pyarrow(chunksize):
+    pytest.importorskip("pyarrow")
+    chunks = list(
+        sas7bdat._sas7bdat.parse_file(TEST_FILE, chunksize=chunksize, string_storage="pyarrow")
+    )
+    assert isinstance(chunks[0]["Column2"].dtype, pd.StringDtype)
+    assert chunks[0]["Column2"].dtype.storage == "pyarrow"
+    df = pd.concat(pd.DataFrame(chunk) for chunk in chunks).reset_index(drop=True)
+    expected = _read()
+    for col in expected:
+        if isinstance(df[col].dtype, pd.StringDtype):
+            assert df[col].isna().equals(expected[col].isna())
+            assert list(df[col].dropna()) == list(expected[col].dropna())
+        else:
+            pd.testing.assert_series_equal(df[col], expected[col])
+
+
+@pytest.mark.parametrize("chunksize", [None, 3])
+@pytest.mark.parametrize(
+    "encoding", ["iso-8859-15", "windows-1252", "utf-8", "cp850", "windows-1250", "mac-roman"]
+)
+def test_non_ascii_strings(tmp_path, encoding, chunksize):
+    # Chunks and cells with and without the bytes that decide between encoding variants
+    replacements = {
+        "iso-8859-15": {b"pear": "pé€r", b"crocodile": "crocodilé"},
+        "windows-1252": {b"pear": "pé¤r", b"dog": "d€g", b"crocodile": "crocodilé"},
+        "utf-8": {b"pear": "pïr", b"crocodile": "crocod€"},
+        "cp850": {b"pear": "pëär", b"dog": "døg"},
+        "windows-1250": {b"pear": "pąšr", b"dog": "dőg"},
+        "mac-roman": {b"pear": "p∑ar", b"crocodile": "crocodilé"},
+    }
+    data = TEST_FILE.read_bytes()
+    for old, new in replacements[encoding].items():
+        data = data.replace(old, new.encode(encoding))
+    test_file = tmp_path / TEST_FILE.name
+    test_file.write_bytes(data)
+    pd_df = pd.read_sas(test_file, encoding=encoding)
+    chunks = sas7bdat._sas7bdat.parse_file(test_file, encoding=encoding, chunksize=chunksize)
+    df = pd.concat(pd.DataFrame(chunk) for chunk in chunks).reset_index(drop=True)
+    pd.testing.assert_frame_equal(df, pd_df)
+
+
+@pytest.mark.parametrize("encoding", ["infer", "windows-1252"])
+def test_non_ascii_column_names(tmp_path, encoding):
+    # The file is windows-1252; names are matched in its encoding and in UTF-8
+    test_file = tmp_path / TEST_FILE.name
+    test_file.write_bytes(TEST_FILE.read_bytes().replace(b"Column12", "Colümn12".encode("windows-1252")))
+    expected = _read().rename(columns={"Column12": "Colümn12"})
+    threshold = datetime.date(1975, 1, 1)
+    df = _read_file(
+        test_file, encoding=encoding, usecols=["Column1", "Colümn12"], filters=[("Colümn12", ">=", threshold)]
+    )
+    expected_rows = expected[expected["Colümn12"] >= pd.Timestamp(threshold)].reset_index(drop=True)
+    assert 0 < len(df) < len(expected)
+    pd.testing.assert_frame_equal(df, expected_rows[["Column1", "Colümn12"]])
+    df = _read_file(test_file, encoding=encoding, column_formats={"Colümn12": "double"})
+    assert df["Colümn12"].dtype == "float64"
+
+
+@pytest.mark.parametrize("chunksize", [None, 3])
+@pytest.mark.parametrize("kwargs", [{}, {"use_mmap": False}, {"infer_dtypes": True}])
+def test_prefetch_chunks(chunksize, kwargs):
+    df = _read(prefetch_chunks=2, chunksize=chunksize, **kwargs)
+    pd.testing.assert_frame_equal(df, _read(chunksize=chunksize, **kwargs))
+
+
+@pytest.mark.parametrize("chunksize", [None, 3])
+@pytest.mark.parametrize(
+    "kwargs",
+    [
+        {},
+        {"copy_arrays": False},
+        {"copy_arrays": False, "infer_dtypes": True},
+        {"copy_arrays": False, "categorical": True},
+        {"copy_arrays": False, "prefetch_chunks": 2},
+    ],
+)
+@pytest.mark.parametrize("blocks_api", [None, "constructor"])
+def test_dataframe(monkeypatch, chunksize, kwargs, blocks_api):
+    if blocks_api is not None:
+        monkeypatch.setattr(sas7bdat._sas7bdat, "_pandas_blocks_api", lambda pd: blocks_api)
+    chunks = list(
+        sas7bdat._sas7bdat.parse_file(TEST_FILE, chunksize=chunksize, dataframe=True, **kwargs)
+    )
+    if kwargs == {"copy_arrays": False} and blocks_api is None:
+        # The columns of a dtype are one block
+        assert sum(block.dtype == "float64" for block in chunks[0]._mgr.blocks) == 1
+    df = pd.concat(chunks).reset_index(drop=True)
+    pd.testing.assert_frame_equal(df, _read(chunksize=chunksize, **kwargs))
+
+
+@pytest.mark.parametrize("copy_arrays", [None, True, False])
+def test_copy_arrays(copy_arrays):
+    kwargs = {} if copy_arrays is None else {"copy_arrays": copy_arrays}
+    chunk = next(sas7bdat._sas7bdat.parse_file(TEST_FILE, chunksize=3, **kwargs))
+    # Copies by default
+    assert chunk["Column1"].flags.owndata == (copy_arrays is not False)
+
+
+def _prefetch_threads():
+    return [t for t in threading.enumerate() if t.name == "sas7bdat-prefetch"]
+
+
+@pytest.mark.parametrize("stop", ["close", "del"])
+def test_prefetch_chunks_close(stop):
+    chunks = sas7bdat._sas7bdat.parse_file(TEST_FILE, chunksize=1, prefetch_chunks=1)
+    next(chunks)
+    assert len(_prefetch_threads()) == 1
+    if stop == "close":
+        chunks.close()
+    else:
+        del chunks
+    assert not _prefetch_threads()
+
+
+def test_prefetch_error_after_close():
+    failed = threading.Event()
+
+    def chunks():
+        yield 1
+        try:
+            raise OSError("Read failed")
+        finally:
+            failed.set()
+
+    prefetched = sas7bdat._sas7bdat._prefetch(chunks(), 2)
+    assert next(prefetched) == 1
+    failed.wait()
+    with pytest.raises(OSError, match="Read failed"):
+        prefetched.close()
+    assert not _prefetch_threads()
+
+
+def test_prefetch_chunks_error():
+    class FailingFile(io.BytesIO):
+        def read(self, size=-1):
+            if self.tell() >= 100_000:
+                raise OSError("Read failed")
+            return super().read(size)
+
+    data = TEST_FILE.read_bytes()
+    chunks = sas7bdat._sas7bdat.parse_fileobj(
+        FailingFile(data), fsize=len(data), buffer_size=4096, prefetch_chunks=2
+    )
+    with pytest.raises(OSError, match="Read failed"):
+        list(chunks)
@@ -0,0 +1,162 @@
+// Convert a SAS7BDAT file to an Arrow IPC file (Feather v2), one record batch per chunk of rows,
+// in memory that does not depend on the size of the file.
+// Usage: sas2arrow input.sas7bdat output.arrow [rows per batch]
+#include "src/sas7bdat.cpp"
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+#define DEFAULT_BATCH_ROWS 65536
+#define READ_BUFFER_SIZE (4 << 20)
+#define READ_BUFFERS 4
+
+struct Converter {
+  struct FileSource *source;
+  struct Parser *parser;
+  struct ArrowBatchBuilder *builder;
+  struct ArrowIpcWriter *writer;
+  bool have_builder, have_writer;
+  int out_fd;
+  size_t batch_rows;
+};
+
+static void on_pagefault(void *userdata, size_t requested_data_start, size_t requested_data_len,
+                         size_t *new_data_offset, const uint8_t **new_data, size_t *new_data_len) {
+  struct Converter *conv = (struct Converter *)userdata;
+  file_source_on_pagefault(conv->source, requested_data_start, requested_data_len,
+                           new_data_offset, new_data, new_data_len);
+}
+
+static void on_metadata(void *userdata, const struct FileInfo *fileinfo) {
+  struct Converter *conv = (struct Converter *)userdata;
+  arrow_batch_builder_init(conv->builder, fileinfo, fileinfo->encoding, true, false,
+                           conv->batch_rows);
+  conv->have_builder = true;
+  struct ArrowSchema schema;
+  arrow_batch_builder_export_schema(conv->builder, &schema);
+  try {
+    arrow_ipc_writer_init(conv->writer, conv->out_fd, &schema);
+  } catch (...) {
+    schema.release(&schema);
+    throw;
+  }
+  schema.release(&schema);
+  conv->have_writer = true;
+}
+
+static size_t on_rows(void *userdata, const uint8_t *first_row, size_t n_rows, size_t stride,
+                      bool have_fast_space_offsets) {
+  struct Converter *conv = (struct Converter *)userdata;
+  return arrow_batch_builder_append(conv->builder, conv->parser, first_row, n_rows, stride,
+                                    have_fast_space_offsets);
+}
+
+static void write_batch(struct Converter *conv) {
+  struct ArrowArray batch;
+  arrow_batch_builder_finish(conv->builder, &batch);
+  try {
+    arrow_ipc_writer_write_batch(conv->writer, &batch);
+  } catch (...) {
+    batch.release(&batch);
+    throw;
+  }
+  batch.release(&batch);
+}
+
+static void convert(struct Converter *conv) {
+  struct ParserConfig config = {
+      .userdata = conv,
+      .filesize_override = 0,
+      .column_format_overrides = NULL,
+      .selected_columns = NULL,
+      .row_filter = NULL,
+      .row_filter_len = 0,
+      .metadata_only = false,
+      .max_rows = 0,
+      .max_pages = 0,
+      .arena = NULL,
+      .on_pagefault = on_pagefault,
+      .on_metadata = on_metadata,
+      .on_row = NULL,
+      .on_rows = on_rows,
+  };
+  parser_init(conv->parser, &config);
+  try {
+    // parse() returns when a batch is full and when the file is done
+    bool more;
+    do {
+      more = parse(conv->parser);
+      assume(conv->have_writer, sas7bdat_error("No metadata"));
+      if (arrow_batch_builder_length(conv->builder) > 0) {
+        write_batch(conv);
+      }
+    } while (more);
+    arrow_ipc_writer_finish(conv->writer);
+  } catch (...) {
+    parser_deinit(conv->parser);
+    throw;
+  }
+  parser_deinit(conv->parser);
+}
+
+int main(int argc, char **argv) {
+  if (argc != 3 && argc != 4) {
+    fprintf(stderr, "Usage: %s input.sas7bdat output.arrow [rows per batch]\n", argv[0]);
+    return 2;
+  }
+  struct Converter conv = {};
+  conv.batch_rows = argc == 4 ? strtoull(argv[3], NULL, 10) : DEFAULT_BATCH_ROWS;
+  if (conv.batch_rows == 0) {
+    fprintf(stderr, "Rows per batch must be > 0\n");
+    return 2;
+  }
+  int in_fd = open(argv[1], O_RDONLY);
+  struct stat st;
+  if (in_fd < 0 || fstat(in_fd, &st) != 0) {
+    perror(argv[1]);
+    return 1;
+  }
+  conv.out_fd = open(argv[2], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (conv.out_fd < 0) {
+    perror(argv[2]);
+    return 1;
+  }
+  conv.source = (struct FileSource *)malloc(file_source_struct_size());
+  conv.parser = (struct Parser *)malloc(parser_struct_size());
+  conv.builder = (struct ArrowBatchBuilder *)malloc(arrow_batch_builder_struct_size());
+  conv.writer = (struct ArrowIpcWriter *)malloc(arrow_ipc_writer_struct_size());
+  int status = 0;
+  try {
+    assume(conv.source && conv.parser && conv.builder && conv.writer, std::bad_alloc());
+    file_source_init(conv.source, in_fd, st.st_size, READ_BUFFER_SIZE, READ_BUFFERS);
+    try {
+      convert(&conv);
+    } catch (...) {
+      file_source_deinit(conv.source);
+      throw;
+    }
+    file_source_deinit(conv.source);
+  } catch (const std::exception &e) {
+    fprintf(stderr, "%s: %s\n", argv[1], e.what());
+    status = 1;
+  }
+  if (conv.have_writer) {
+    arrow_ipc_writer_deinit(conv.writer);
+  }
+  if (conv.have_builder) {
+    arrow_batch_builder_deinit(conv.builder);
+  }
+  free(conv.source);
+  free(conv.parser);
+  free(conv.builder);
+  free(conv.writer);
+  close(in_fd);
+  if (close(conv.out_fd) != 0 && status == 0) {
+    perror(argv[2]);
+    status = 1;
+  }
+  if (status != 0) {
+    unlink(argv[2]);
+  }
+  return status;
+}
@@ -0,0 +1,109 @@
+#include <algorithm>
+#include <stdint.h>
+#include <string.h>
+
+#include "../include/sas7bdat.hpp"
+#include "assume.hpp"
+
+// Bump allocator for everything a parser allocates. Blocks grow geometrically, so a parser
+// makes O(log bytes) heap allocations, and all memory is freed at once.
+
+#define ARENA_ALIGNMENT 16
+#define ARENA_MIN_BLOCK_SIZE (16 * 1024)
+#define ARENA_MAX_BLOCK_SIZE (64 * 1024 * 1024)
+
+struct ParserArenaBlock {
+  struct ParserArenaBlock *next;
+  size_t size, used;
+};
+
+struct ParserArena {
+  struct ParserArenaBlock *blocks; // Block that is bumped into first
+  size_t next_block_size;
+};
+
+#define ARENA_BLOCK_HEADER_SIZE                                                                    \
+  ((sizeof(struct ParserArenaBlock) + ARENA_ALIGNMENT - 1) & -ARENA_ALIGNMENT)
+
+static uint8_t *arena_block_data(struct ParserArenaBlock *block) {
+  return (uint8_t *)block + ARENA_BLOCK_HEADER_SIZE;
+}
+
+static struct ParserArenaBlock *arena_new_block(size_t size) {
+  struct ParserArenaBlock *block =
+      (struct ParserArenaBlock *)malloc(ARENA_BLOCK_HEADER_SIZE + size);
+  assume(block != NULL, std::bad_alloc());
+  block->next = NULL;
+  block->size = size;
+  block->used = 0;
+  return block;
+}
+
+// Zeroed memory aligned to ARENA_ALIGNMENT. Never returns NULL, not even for n = 0.
+static void *arena_zalloc(struct ParserArena *arena, size_t n) {
+  assume(n <= SIZE_MAX / 2, std::bad_alloc());
+  n = (n + ARENA_ALIGNMENT - 1) & -ARENA_ALIGNMENT;
+  struct ParserArenaBlock *block = arena->blocks;
+  if (block == NULL || block->size - block->used < n) {
+    size_t block_size = std::max(arena->next_block_size, (size_t)ARENA_MIN_BLOCK_SIZE);
+    if (n > block_size / 2) {
+      // Dedicated block, so that the current block can still be used for small allocations
+      struct ParserArenaBlock *large = arena_new_block(n);
+      large->used = n;
+      if (block == NULL) {
+        arena->blocks = large;
+      } else {
+        large->next = block->next;
+        block->next = large;
+      }
+      memset(arena_block_data(large), 0, n);
+      return arena_block_data(large);
+    }
+    block = arena_new_block(block_size);
+    block->next = arena->blocks;
+    arena->blocks = block;
+    arena->next_block_size = std::min(2 * block_size, (size_t)ARENA_MAX_BLOCK_SIZE);
+  }
+  void *ptr = arena_block_data(block) + block->used;
+  block->used += n;
+  memset(ptr, 0, n);
+  return ptr;
+}
+
+size_t parser_arena_struct_size() {
+  return sizeof(struct ParserArena);
+}
+
+void parser_arena_init(struct ParserArena *arena) {
+  arena->blocks = NULL;
+  arena->next_block_size = ARENA_MIN_BLOCK_SIZE;
+}
+
+void parser_arena_reset(struct ParserArena *arena) {
+  // Keep the largest block for the next parser
+  struct ParserArenaBlock *largest = NULL;
+  for (struct ParserArenaBlock *block = arena->blocks; block != NULL;) {
+    struct ParserArenaBlock *next = block->next;
+    if (largest == NULL || block->size > largest->size) {
+      free(largest);
+      largest = block;
+    } else {
+      free(block);
+    }
+    block = next;
+  }
+  if (largest != NULL) {
+    largest->next = NULL;
+    largest->used = 0;
+  }
+  arena->blocks = largest;
+}
+
+void parser_arena_deinit(struct ParserArena *arena) {
+  for (struct ParserArenaBlock *block = arena->blocks; block != NULL;) {
+    struct ParserArenaBlock *next = block->next;
+    free(block);
+    block = next;
+  }
+  parser_arena_init(arena);
+}
@@ -0,0 +1,749 @@
+#include <algorithm>
+#include <cmath>
+#include <errno.h>
+#include <limits>
+#include <new>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/sas7bdat.hpp"
+#include "arrow_c_data.hpp"
+#include "assume.hpp"
+#include "decimal_batch.hpp"
+#include "encoding_utils.hpp"
+#include "string_utils.hpp"
+#include "transpose.hpp"
+#include "utf8.hpp"
+
+// Columnar buffers of the current batch, in the layouts of the Arrow columnar format. Buffers are
+// malloc'ed so that exported arrays can own them.
+
+#define ARROW_BUFFER_ALIGNMENT 64
+#define ARROW_DECODE_BLOCK_ROWS 256
+
+enum ArrowColumnKind {
+  arrow_column_fixed,  // Fixed-width values
+  arrow_column_bool,   // Bit-packed values
+  arrow_column_string, // int64 offsets and data (large_utf8/large_binary)
+};
+
+struct ArrowColumnBuilder {
+  const struct ColumnInfo *colinfo;
+  enum ArrowColumnKind kind;
+  size_t width; // Bytes per value of fixed-width columns
+  uint8_t *validity;
+  size_t null_count;
+  uint8_t *values; // Values, or offsets of strings
+  uint8_t *data;   // String data
+  size_t data_capacity;
+};
+
+struct ArrowBatchBuilder {
+  const struct FileInfo *fileinfo;
+  enum Encoding encoding;
+  const struct SingleByteCodepage *codepage; // If strings are transcoded from a single-byte encoding
+  bool strings_are_utf8;
+  bool blank_as_null;
+  bool strings_only;
+  size_t capacity, length;
+  struct ArrowColumnBuilder *columns;
+  size_t n_columns;
+  size_t *column_index; // Of each column of the file in 'columns', SIZE_MAX if it is not built
+  uint8_t **span_out;
+  double decode_buf[ARROW_DECODE_BLOCK_ROWS];
+};
+
+static void *arrow_alloc(size_t n) {
+  n = std::max<size_t>((n + ARROW_BUFFER_ALIGNMENT - 1) & -ARROW_BUFFER_ALIGNMENT,
+                       ARROW_BUFFER_ALIGNMENT);
+  void *ptr = aligned_alloc(ARROW_BUFFER_ALIGNMENT, n);
+  assume(ptr != NULL, std::bad_alloc());
+  return ptr;
+}
+
+static size_t arrow_bitmap_size(size_t n_bits) {
+  return (n_bits + 7) / 8;
+}
+
+static void arrow_bitmap_clear(uint8_t *bitmap, size_t pos) {
+  bitmap[pos / 8] &= ~(1 << (pos % 8));
+}
+
+static void arrow_bitmap_set_to(uint8_t *bitmap, size_t pos, bool v) {
+  bitmap[pos / 8] = (bitmap[pos / 8] & ~(1 << (pos % 8))) | (v << (pos % 8));
+}
+
+// Arrow format string and value width of a column
+static const char *arrow_column_format(const struct ArrowBatchBuilder *builder,
+                                       const struct ColumnInfo *colinfo, size_t *width) {
+  *width = 0;
+  switch (colinfo->format) {
+  case column_format_string:
+    return builder->strings_are_utf8 ? "U" : "Z";
+  case column_format_raw:
+    *width = colinfo->len;
+    return NULL; // Parametrized, see arrow_schema_format()
+  case column_format_double:
+    *width = 8;
+    return "g";
+  case column_format_float:
+    *width = 4;
+    return "f";
+  case column_format_bool:
+    return "b";
+  case column_format_int8:
+    *width = 1;
+    return "c";
+  case column_format_uint8:
+    *width = 1;
+    return "C";
+  case column_format_int16:
+    *width = 2;
+    return "s";
+  case column_format_uint16:
+    *width = 2;
+    return "S";
+  case column_format_int32:
+    *width = 4;
+    return "i";
+  case column_format_uint32:
+    *width = 4;
+    return "I";
+  case column_format_int64:
+    *width = 8;
+    return "l";
+  case column_format_uint64:
+    *width = 8;
+    return "L";
+  case column_format_date:
+    *width = 4;
+    return "tdD";
+  case column_format_datetime:
+    *width = 8;
+    return "tss:";
+  default:
+    throw std::invalid_argument("Unsupported column format");
+  }
+}
+
+static void arrow_column_alloc(struct ArrowColumnBuilder *col, size_t capacity) {
+  col->null_count = 0;
+  col->validity = (uint8_t *)arrow_alloc(arrow_bitmap_size(capacity));
+  memset(col->validity, 0xff, arrow_bitmap_size(capacity));
+  switch (col->kind) {
+  case arrow_column_fixed:
+    col->values = (uint8_t *)arrow_alloc(capacity * col->width);
+    break;
+  case arrow_column_bool:
+    col->values = (uint8_t *)arrow_alloc(arrow_bitmap_size(capacity));
+    memset(col->values, 0, arrow_bitmap_size(capacity));
+    break;
+  case arrow_column_string:
+    col->values = (uint8_t *)arrow_alloc((capacity + 1) * sizeof(int64_t));
+    ((int64_t *)col->values)[0] = 0;
+    col->data_capacity = 0;
+    col->data = NULL;
+    break;
+  }
+}
+
+static void arrow_column_free(struct ArrowColumnBuilder *col) {
+  free(col->validity);
+  free(col->values);
+  free(col->data);
+  col->validity = col->values = col->data = NULL;
+}
+
+size_t arrow_batch_builder_struct_size() {
+  return sizeof(struct ArrowBatchBuilder);
+}
+
+void arrow_batch_builder_init(struct ArrowBatchBuilder *builder, const struct FileInfo *fileinfo,
+                              enum Encoding encoding, bool blank_as_null, bool strings_only,
+                              size_t capacity) {
+  memset(builder, 0, sizeof(*builder));
+  builder->fileinfo = fileinfo;
+  builder->encoding = encoding;
+  builder->codepage = single_byte_codepage(encoding);
+  builder->strings_are_utf8 =
+      builder->codepage != NULL || encoding == encoding_utf_8 || encoding == encoding_ascii;
+  builder->blank_as_null = blank_as_null;
+  builder->strings_only = strings_only;
+  builder->capacity = capacity;
+  builder->columns = (struct ArrowColumnBuilder *)calloc(
+      std::max<size_t>(fileinfo->column_count, 1), sizeof(struct ArrowColumnBuilder));
+  builder->column_index =
+      (size_t *)malloc(std::max<size_t>(fileinfo->column_count, 1) * sizeof(size_t));
+  builder->span_out =
+      (uint8_t **)malloc(std::max<size_t>(fileinfo->column_count, 1) * sizeof(uint8_t *));
+  if (builder->columns == NULL || builder->column_index == NULL || builder->span_out == NULL) {
+    arrow_batch_builder_deinit(builder);
+    throw std::bad_alloc();
+  }
+  try {
+    for (size_t col_idx = 0; col_idx < fileinfo->column_count; ++col_idx) {
+      builder->column_index[col_idx] = SIZE_MAX;
+      if (strings_only && fileinfo->columns[col_idx].format != column_format_string) {
+        continue;
+      }
+      builder->column_index[col_idx] = builder->n_columns;
+      struct ArrowColumnBuilder *col = &builder->columns[builder->n_columns++];
+      col->colinfo = &fileinfo->columns[col_idx];
+      arrow_column_format(builder, col->colinfo, &col->width);
+      col->kind = col->colinfo->format == column_format_string ? arrow_column_string
+                  : col->colinfo->format == column_format_bool ? arrow_column_bool
+                                                               : arrow_column_fixed;
+      arrow_column_alloc(col, capacity);
+    }
+  } catch (...) {
+    arrow_batch_builder_deinit(builder);
+    throw;
+  }
+}
+
+void arrow_batch_builder_deinit(struct ArrowBatchBuilder *builder) {
+  for (size_t i = 0; i < builder->n_columns; ++i) {
+    arrow_column_free(&builder->columns[i]);
+  }
+  free(builder->columns);
+  free(builder->column_index);
+  free(builder->span_out);
+  builder->columns = NULL;
+  builder->column_index = NULL;
+  builder->span_out = NULL;
+  builder->n_columns = 0;
+}
+
+size_t arrow_batch_builder_length(const struct ArrowBatchBuilder *builder) {
+  return builder->length;
+}
+
+// Appending
+
+// Builder of column k of a span
+static struct ArrowColumnBuilder *arrow_span_column(struct ArrowBatchBuilder *builder,
+                                                    const struct ColumnSpan *span, size_t k) {
+  size_t col_idx = builder->fileinfo->column_order[span->first_column + k];
+  return &builder->columns[builder->column_index[col_idx]];
+}
+
+// Store v at dst if it is in the range of T
+template <typename T>
+static bool arrow_store_integer(uint8_t *dst, double v) {
+  // Values in (min - 1, max + 1) truncate to a value in range
+  if (!(v > (double)std::numeric_limits<T>::min() - 1. &&
+        v < (double)std::numeric_limits<T>::max() + 1.)) {
+    return false;
+  }
+  T t = (T)v;
+  memcpy(dst, &t, sizeof(t));
+  return true;
+}
+
+// Store the number 'value' (in SAS units) at row 'row' of a numeric column. Missing values and
+// values that don't fit the column's type are null.
+static void arrow_store_number(struct ArrowColumnBuilder *col, size_t row, double value) {
+  uint8_t *dst = col->values + row * col->width;
+  bool ok = !std::isnan(value);
+  switch (col->colinfo->format) {
+  case column_format_double:
+    memcpy(dst, &value, 8); // Keeps the payload of missing values
+    break;
+  case column_format_float: {
+    float f = value;
+    memcpy(dst, &f, 4);
+    break;
+  }
+  case column_format_bool:
+    arrow_bitmap_set_to(col->values, row, ok && value != 0);
+    break;
+  case column_format_int8:
+    ok = ok && arrow_store_integer<int8_t>(dst, value);
+    break;
+  case column_format_uint8:
+    ok = ok && arrow_store_integer<uint8_t>(dst, value);
+    break;
+  case column_format_int16:
+    ok = ok && arrow_store_integer<int16_t>(dst, value);
+    break;
+  case column_format_uint16:
+    ok = ok && arrow_store_integer<uint16_t>(dst, value);
+    break;
+  case column_format_int32:
+    ok = ok && arrow_store_integer<int32_t>(dst, value);
+    break;
+  case column_format_uint32:
+    ok = ok && arrow_store_integer<uint32_t>(dst, value);
+    break;
+  case column_format_int64:
+    ok = ok && arrow_store_integer<int64_t>(dst, value);
+    break;
+  case column_format_uint64:
+    ok = ok && arrow_store_integer<uint64_t>(dst, value);
+    break;
+  case column_format_date:
+    // Days since 1970-01-01
+    ok = ok && arrow_store_integer<int32_t>(dst, trunc(value) - 3653);
+    break;
+  case column_format_datetime:
+    // Seconds since 1970-01-01
+    ok = ok && arrow_store_integer<int64_t>(dst, trunc(value) - 3653 * 24 * 3600);
+    break;
+  default:
+    __builtin_unreachable();
+  }
+  if (!ok) {
+    arrow_bitmap_clear(col->validity, row);
+    ++col->null_count;
+    if (col->kind == arrow_column_fixed && col->colinfo->format != column_format_double) {
+      memset(dst, 0, col->width);
+    }
+  }
+}
+
+// Native 8-byte doubles: transpose the span into the value buffers, then find the missing values
+static void arrow_append_span_double(struct ArrowBatchBuilder *builder,
+                                     const struct ColumnSpan *span, const uint8_t *first_row,
+                                     size_t n_rows, size_t stride) {
+  for (size_t k = 0; k < span->n_columns; ++k) {
+    struct ArrowColumnBuilder *col = arrow_span_column(builder, span, k);
+    builder->span_out[k] = col->values + 8 * builder->length;
+  }
+  transpose8(first_row + span->offset, n_rows, stride, span->n_columns, builder->span_out);
+  for (size_t k = 0; k < span->n_columns; ++k) {
+    struct ArrowColumnBuilder *col = arrow_span_column(builder, span, k);
+    const double *values = (const double *)builder->span_out[k];
+    for (size_t r = 0; r < n_rows; ++r) {
+      if (std::isnan(values[r])) {
+        arrow_bitmap_clear(col->validity, builder->length + r);
+        ++col->null_count;
+      }
+    }
+  }
+}
+
+static void arrow_append_span_numbers(struct ArrowBatchBuilder *builder,
+                                      const struct ColumnSpan *span, const uint8_t *first_row,
+                                      size_t n_rows, size_t stride) {
+  for (size_t k = 0; k < span->n_columns; ++k) {
+    struct ArrowColumnBuilder *col = arrow_span_column(builder, span, k);
+    const uint8_t *src = first_row + span->offset + k * span->column_len;
+    for (size_t block_start = 0; block_start < n_rows; block_start += ARROW_DECODE_BLOCK_ROWS) {
+      size_t block_len = std::min<size_t>(n_rows - block_start, ARROW_DECODE_BLOCK_ROWS);
+      decimal2double_batch(src + block_start * stride, block_len, stride, span->column_len,
+                           builder->fileinfo->is_little_endian, builder->decode_buf);
+      for (size_t i = 0; i < block_len; ++i) {
+        arrow_store_number(col, builder->length + block_start + i, builder->decode_buf[i]);
+      }
+    }
+  }
+}
+
+static void arrow_append_string_column(struct ArrowBatchBuilder *builder,
+                                       const struct Parser *parser,
+                                       struct ArrowColumnBuilder *col, const uint8_t *first_row,
+                                       size_t n_rows, size_t stride,
+                                       bool have_fast_space_offsets) {
+  int64_t *offsets = (int64_t *)col->values;
+  const struct ColumnInfo *colinfo = col->colinfo;
+  // Reserve space for the worst case, so that cells can be appended without checks
+  size_t data_len = offsets[builder->length];
+  size_t max_expansion = builder->strings_are_utf8 ? UTF8_MAX_EXPANSION : 1;
+  size_t needed = data_len + n_rows * colinfo->len * max_expansion;
+  if (needed > col->data_capacity) {
+    size_t new_capacity = std::max(needed, 2 * col->data_capacity);
+    uint8_t *data = (uint8_t *)arrow_alloc(new_capacity);
+    if (col->data != NULL) {
+      memcpy(data, col->data, data_len);
+      free(col->data);
+    }
+    col->data = data;
+    col->data_capacity = new_capacity;
+  }
+
+  // All-ASCII chunks of a column, the common case, are valid UTF-8 as they are
+  bool transcode = (builder->codepage != NULL || builder->strings_are_utf8) &&
+                   classify_column(first_row + colinfo->offset, n_rows, stride, colinfo->len,
+                                   BYTE_CLASS_NON_ASCII);
+  if (transcode && builder->codepage != NULL) {
+    transcode_column_to_utf8(builder->codepage, parser, colinfo, first_row, n_rows, stride,
+                             have_fast_space_offsets, col->data, &offsets[builder->length]);
+    for (size_t row_idx = builder->length; row_idx < builder->length + n_rows; ++row_idx) {
+      if (builder->blank_as_null && offsets[row_idx + 1] == offsets[row_idx]) {
+        arrow_bitmap_clear(col->validity, row_idx);
+        ++col->null_count;
+      }
+    }
+    return;
+  }
+
+  const uint8_t *row = first_row;
+  for (size_t r = 0; r < n_rows; ++r, row += stride) {
+    size_t row_idx = builder->length + r;
+    size_t len = string_cell_len(parser, colinfo, row, r, have_fast_space_offsets);
+    const uint8_t *s = &row[colinfo->offset];
+    if (len == 0 && builder->blank_as_null) {
+      arrow_bitmap_clear(col->validity, row_idx);
+      ++col->null_count;
+    } else if (transcode) {
+      data_len += sanitize_utf8(s, len, &col->data[data_len]);
+    } else {
+      memcpy(&col->data[data_len], s, len);
+      data_len += len;
+    }
+    offsets[row_idx + 1] = data_len;
+  }
+}
+
+size_t arrow_batch_builder_append(struct ArrowBatchBuilder *builder, const struct Parser *parser,
+                                  const uint8_t *first_row, size_t n_rows, size_t stride,
+                                  bool have_fast_space_offsets) {
+  const struct FileInfo *fileinfo = builder->fileinfo;
+  n_rows = std::min(n_rows, builder->capacity - builder->length);
+  if (n_rows == 0) {
+    return 0;
+  }
+  // Column-major, span by span, like the Python consumer
+  for (size_t span_idx = 0; span_idx < fileinfo->span_count; ++span_idx) {
+    const struct ColumnSpan *span = &fileinfo->spans[span_idx];
+    if (builder->strings_only && span->format != column_format_string) {
+      continue;
+    }
+    if (span->format == column_format_double && span->column_len == 8 &&
+        !fileinfo->need_byteswap) {
+      arrow_append_span_double(builder, span, first_row, n_rows, stride);
+    } else if (span->format != column_format_raw && span->format != column_format_string) {
+      arrow_append_span_numbers(builder, span, first_row, n_rows, stride);
+    } else {
+      for (size_t k = 0; k < span->n_columns; ++k) {
+        struct ArrowColumnBuilder *col = arrow_span_column(builder, span, k);
+        if (span->format == column_format_string) {
+          arrow_append_string_column(builder, parser, col, first_row, n_rows, stride,
+                                     have_fast_space_offsets);
+        } else {
+          const uint8_t *src = first_row + col->colinfo->offset;
+          for (size_t r = 0; r < n_rows; ++r) {
+            memcpy(col->values + (builder->length + r) * col->width, src + r * stride,
+                   col->width);
+          }
+        }
+      }
+    }
+  }
+  builder->length += n_rows;
+  return n_rows;
+}
+
+// Export. Exported arrays and schemas own their memory, and are independent of the builder.
+
+struct ArrowExportedArray {
+  const void *buffers[3];
+  struct ArrowArray **children;
+  struct ArrowArray *children_storage;
+};
+
+static void arrow_release_array(struct ArrowArray *array) {
+  struct ArrowExportedArray *exported = (struct ArrowExportedArray *)array->private_data;
+  for (int64_t i = 0; i < array->n_children; ++i) {
+    if (exported->children[i]->release != NULL) {
+      exported->children[i]->release(exported->children[i]);
+    }
+  }
+  for (int64_t i = 0; i < array->n_buffers; ++i) {
+    free((void *)exported->buffers[i]);
+  }
+  free(exported->children);
+  free(exported->children_storage);
+  free(exported);
+  array->release = NULL;
+}
+
+// Array with 'n_children' children, which are initialized by the caller
+static void arrow_array_init(struct ArrowArray *array, int64_t length, int64_t n_buffers,
+                             int64_t n_children) {
+  struct ArrowExportedArray *exported =
+      (struct ArrowExportedArray *)calloc(1, sizeof(struct ArrowExportedArray));
+  assume(exported != NULL, std::bad_alloc());
+  if (n_children > 0) {
+    exported->children = (struct ArrowArray **)calloc(n_children, sizeof(struct ArrowArray *));
+    exported->children_storage =
+        (struct ArrowArray *)calloc(n_children, sizeof(struct ArrowArray));
+    if (exported->children == NULL || exported->children_storage == NULL) {
+      free(exported->children);
+      free(exported->children_storage);
+      free(exported);
+      throw std::bad_alloc();
+    }
+    for (int64_t i = 0; i < n_children; ++i) {
+      exported->children[i] = &exported->children_storage[i];
+    }
+  }
+  *array = {
+      .length = length,
+      .null_count = 0,
+      .offset = 0,
+      .n_buffers = n_buffers,
+      .n_children = n_children,
+      .buffers = exported->buffers,
+      .children = exported->children,
+      .dictionary = NULL,
+      .release = arrow_release_array,
+      .private_data = exported,
+  };
+}
+
+void arrow_batch_builder_finish(struct ArrowBatchBuilder *builder, struct ArrowArray *out) {
+  size_t column_count = builder->n_columns;
+  // Allocate everything first, so that the builder is unchanged if allocation fails
+  struct ArrowArray batch;
+  arrow_array_init(&batch, builder->length, 1, column_count);
+  struct ArrowColumnBuilder *next = (struct ArrowColumnBuilder *)calloc(
+      std::max<size_t>(column_count, 1), sizeof(struct ArrowColumnBuilder));
+  size_t n_initialized = 0;
+  try {
+    assume(next != NULL, std::bad_alloc());
+    for (; n_initialized < column_count; ++n_initialized) {
+      struct ArrowColumnBuilder *col = &builder->columns[n_initialized];
+      arrow_array_init(batch.children[n_initialized], builder->length,
+                       col->kind == arrow_column_string ? 3 : 2, 0);
+      next[n_initialized] = *col;
+      next[n_initialized].validity = next[n_initialized].values = next[n_initialized].data = NULL;
+      arrow_column_alloc(&next[n_initialized], builder->capacity);
+    }
+    for (size_t col_idx = 0; col_idx < column_count; ++col_idx) {
+      struct ArrowColumnBuilder *col = &builder->columns[col_idx];
+      if (col->kind == arrow_column_string && col->data == NULL) {
+        col->data = (uint8_t *)arrow_alloc(0);
+      }
+    }
+  } catch (...) {
+    if (next != NULL) {
+      for (size_t col_idx = 0; col_idx <= n_initialized && col_idx < column_count; ++col_idx) {
+        arrow_column_free(&next[col_idx]);
+      }
+      free(next);
+    }
+    batch.release(&batch);
+    throw;
+  }
+
+  // Move the buffers to the exported columns
+  for (size_t col_idx = 0; col_idx < column_count; ++col_idx) {
+    struct ArrowColumnBuilder *col = &builder->columns[col_idx];
+    struct ArrowArray *child = batch.children[col_idx];
+    struct ArrowExportedArray *exported = (struct ArrowExportedArray *)child->private_data;
+    if (col->null_count == 0) {
+      free(col->validity);
+      col->validity = NULL;
+    }
+    child->null_count = col->null_count;
+    exported->buffers[0] = col->validity;
+    exported->buffers[1] = col->values;
+    exported->buffers[2] = col->data;
+    *col = next[col_idx];
+  }
+  free(next);
+  builder->length = 0;
+  *out = batch;
+}
+
+struct ArrowExportedSchema {
+  char *format;
+  char *name;
+  struct ArrowSchema **children;
+  struct ArrowSchema *children_storage;
+};
+
+static void arrow_release_schema(struct ArrowSchema *schema) {
+  struct ArrowExportedSchema *exported = (struct ArrowExportedSchema *)schema->private_data;
+  for (int64_t i = 0; i < schema->n_children; ++i) {
+    if (exported->children[i]->release != NULL) {
+      exported->children[i]->release(exported->children[i]);
+    }
+  }
+  free(exported->format);
+  free(exported->name);
+  free(exported->children);
+  free(exported->children_storage);
+  free(exported);
+  schema->release = NULL;
+}
+
+// Schema with 'n_children' children, which are initialized by the caller. Takes ownership of the
+// malloc'ed strings 'format' and 'name', also if it fails.
+static void arrow_schema_init(struct ArrowSchema *schema, char *format, char *name, int64_t flags,
+                              int64_t n_children) {
+  struct ArrowExportedSchema *exported =
+      (struct ArrowExportedSchema *)calloc(1, sizeof(struct ArrowExportedSchema));
+  bool ok = exported != NULL && format != NULL && name != NULL;
+  if (ok && n_children > 0) {
+    exported->children = (struct ArrowSchema **)calloc(n_children, sizeof(struct ArrowSchema *));
+    exported->children_storage =
+        (struct ArrowSchema *)calloc(n_children, sizeof(struct ArrowSchema));
+    ok = exported->children != NULL && exported->children_storage != NULL;
+  }
+  if (!ok) {
+    if (exported != NULL) {
+      free(exported->children);
+      free(exported->children_storage);
+    }
+    free(exported);
+    free(format);
+    free(name);
+    throw std::bad_alloc();
+  }
+  for (int64_t i = 0; i < n_children; ++i) {
+    exported->children[i] = &exported->children_storage[i];
+  }
+  exported->format = format;
+  exported->name = name;
+  *schema = {
+      .format = format,
+      .name = name,
+      .metadata = NULL,
+      .flags = flags,
+      .n_children = n_children,
+      .children = exported->children,
+      .dictionary = NULL,
+      .release = arrow_release_schema,
+      .private_data = exported,
+  };
+}
+
+static char *arrow_strdup(const char *s, size_t len) {
+  char *dup = (char *)malloc(len + 1);
+  if (dup != NULL) {
+    memcpy(dup, s, len);
+    dup[len] = '\0';
+  }
+  return dup;
+}
+
+void arrow_batch_builder_export_schema(const struct ArrowBatchBuilder *builder,
+                                       struct ArrowSchema *out) {
+  size_t column_count = builder->n_columns;
+  struct ArrowSchema schema;
+  arrow_schema_init(&schema, arrow_strdup("+s", 2), arrow_strdup("", 0), 0, column_count);
+  try {
+    for (size_t col_idx = 0; col_idx < column_count; ++col_idx) {
+      const struct ColumnInfo *colinfo = builder->columns[col_idx].colinfo;
+      size_t width;
+      const char *format = arrow_column_format(builder, colinfo, &width);
+      char raw_format[32];
+      if (format == NULL) {
+        snprintf(raw_format, sizeof(raw_format), "w:%u", (unsigned)colinfo->len);
+        format = raw_format;
+      }
+      // Column names must be UTF-8 as well
+      size_t name_len = strlen(colinfo->name);
+      char *name = (char *)malloc(name_len * UTF8_MAX_EXPANSION + 1);
+      if (name != NULL) {
+        name_len = builder->codepage != NULL
+                       ? transcode_single_byte_to_utf8(builder->codepage,
+                                                       (const uint8_t *)colinfo->name, name_len,
+                                                       (uint8_t *)name)
+                       : sanitize_utf8((const uint8_t *)colinfo->name, name_len, (uint8_t *)name);
+        name[name_len] = '\0';
+      }
+      arrow_schema_init(schema.children[col_idx], arrow_strdup(format, strlen(format)), name,
+                        ARROW_FLAG_NULLABLE, 0);
+    }
+  } catch (...) {
+    schema.release(&schema);
+    throw;
+  }
+  *out = schema;
+}
+
+void arrow_schema_deep_copy(const struct ArrowSchema *src, struct ArrowSchema *dst) {
+  assume(src->dictionary == NULL && src->metadata == NULL,
+         std::invalid_argument("Schemas with dictionaries or metadata are not supported"));
+  struct ArrowSchema copy;
+  arrow_schema_init(&copy, arrow_strdup(src->format, strlen(src->format)),
+                    arrow_strdup(src->name, strlen(src->name)), src->flags, src->n_children);
+  try {
+    for (int64_t i = 0; i < src->n_children; ++i) {
+      arrow_schema_deep_copy(src->children[i], copy.children[i]);
+    }
+  } catch (...) {
+    copy.release(&copy);
+    throw;
+  }
+  *dst = copy;
+}
+
+// Stream of exported batches
+
+struct ArrowBatchStream {
+  struct ArrowSchema schema;
+  struct ArrowArray *batches;
+  size_t n_batches, next_batch;
+  char error[128];
+};
+
+static int arrow_batch_stream_get_schema(struct ArrowArrayStream *stream, struct ArrowSchema *out) {
+  struct ArrowBatchStream *private_data = (struct ArrowBatchStream *)stream->private_data;
+  try {
+    arrow_schema_deep_copy(&private_data->schema, out);
+  } catch (const std::exception &e) {
+    snprintf(private_data->error, sizeof(private_data->error), "%s", e.what());
+    return ENOMEM;
+  }
+  return 0;
+}
+
+static int arrow_batch_stream_get_next(struct ArrowArrayStream *stream, struct ArrowArray *out) {
+  struct ArrowBatchStream *private_data = (struct ArrowBatchStream *)stream->private_data;
+  if (private_data->next_batch == private_data->n_batches) {
+    out->release = NULL; // End of stream
+  } else {
+    *out = private_data->batches[private_data->next_batch++];
+  }
+  return 0;
+}
+
+static const char *arrow_batch_stream_get_last_error(struct ArrowArrayStream *stream) {
+  struct ArrowBatchStream *private_data = (struct ArrowBatchStream *)stream->private_data;
+  return private_data->error[0] ? private_data->error : NULL;
+}
+
+static void arrow_batch_stream_release(struct ArrowArrayStream *stream) {
+  struct ArrowBatchStream *private_data = (struct ArrowBatchStream *)stream->private_data;
+  for (size_t i = private_data->next_batch; i < private_data->n_batches; ++i) {
+    private_data->batches[i].release(&private_data->batches[i]);
+  }
+  private_data->schema.release(&private_data->schema);
+  free(private_data->batches);
+  free(private_data);
+  stream->release = NULL;
+}
+
+void arrow_batch_stream_init(struct ArrowArrayStream *stream, struct ArrowSchema *schema,
+                             struct ArrowArray *batches, size_t n_batches) {
+  struct ArrowBatchStream *private_data =
+      (struct ArrowBatchStream *)calloc(1, sizeof(struct ArrowBatchStream));
+  struct ArrowArray *batches_copy =
+      (struct ArrowArray *)malloc(std::max<size_t>(n_batches, 1) * sizeof(struct ArrowArray));
+  if (private_data == NULL || batches_copy == NULL) {
+    free(private_data);
+    free(batches_copy);
+    throw std::bad_alloc();
+  }
+  private_data->schema = *schema;
+  schema->release = NULL;
+  for (size_t i = 0; i < n_batches; ++i) {
+    batches_copy[i] = batches[i];
+    batches[i].release = NULL;
+  }
+  private_data->batches = batches_copy;
+  private_data->n_batches = n_batches;
+  *stream = {
+      .get_schema = arrow_batch_stream_get_schema,
+      .get_next = arrow_batch_stream_get_next,
+      .get_last_error = arrow_batch_stream_get_last_error,
+      .release = arrow_batch_stream_release,
+      .private_data = private_data,
+  };
+}
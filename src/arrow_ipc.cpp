@@ -0,0 +1,457 @@
+#include <algorithm>
+#include <errno.h>
+#include <new>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <system_error>
+#include <unistd.h>
+
+#include "../include/sas7bdat.hpp"
+#include "arrow_c_data.hpp"
+#include "assume.hpp"
+
+// Arrow IPC file format (https://arrow.apache.org/docs/format/Columnar.html#ipc-file-format):
+//   "ARROW1\0\0", schema message, record batch messages, end-of-stream marker,
+//   footer (schema and locations of the record batches), footer size, "ARROW1"
+// Messages are FlatBuffers (Message.fbs, Schema.fbs, File.fbs in the Arrow repository) followed
+// by the message body, ie. the buffers of the record batch.
+
+#define ARROW_IPC_ALIGNMENT 8
+#define ARROW_IPC_CONTINUATION 0xffffffffu
+#define ARROW_IPC_METADATA_V5 4
+
+// Union types of Message.header and Field.type
+enum ArrowIpcMessageHeader : uint8_t {
+  arrow_ipc_header_schema = 1,
+  arrow_ipc_header_record_batch = 3,
+};
+
+enum ArrowIpcType : uint8_t {
+  arrow_ipc_type_int = 2,
+  arrow_ipc_type_floating_point = 3,
+  arrow_ipc_type_bool = 6,
+  arrow_ipc_type_date = 8,
+  arrow_ipc_type_timestamp = 10,
+  arrow_ipc_type_fixed_size_binary = 15,
+  arrow_ipc_type_large_binary = 19,
+  arrow_ipc_type_large_utf8 = 20,
+};
+
+// Structs of the FlatBuffers schemas, which have the same layout in C
+struct ArrowIpcBlock {
+  int64_t offset;
+  int32_t metadata_length;
+  int32_t padding;
+  int64_t body_length;
+};
+
+struct ArrowIpcFieldNode {
+  int64_t length;
+  int64_t null_count;
+};
+
+struct ArrowIpcBuffer {
+  int64_t offset;
+  int64_t length;
+};
+
+// Minimal FlatBuffers builder. Like the reference implementation, it builds the buffer back to
+// front, so that the children of a table are written before the table and all offsets point
+// forward. Objects are referenced by their distance from the end of the buffer ("ref").
+
+#define FLATBUF_MAX_FIELDS 8
+
+struct FlatBuilder {
+  uint8_t *buf; // The buffer is buf[capacity - size, capacity)
+  size_t capacity, size;
+  size_t max_align;
+  // Of the table being built
+  size_t table_start;
+  size_t n_fields;
+  size_t field_refs[FLATBUF_MAX_FIELDS]; // 0 if the field is not set
+};
+
+static void flatbuf_reset(struct FlatBuilder *fb) {
+  fb->size = 0;
+  fb->max_align = 1;
+}
+
+static void flatbuf_reserve(struct FlatBuilder *fb, size_t n) {
+  if (fb->size + n <= fb->capacity) {
+    return;
+  }
+  size_t new_capacity = std::max({2 * fb->capacity, fb->size + n, (size_t)1024});
+  uint8_t *new_buf = (uint8_t *)malloc(new_capacity);
+  assume(new_buf != NULL, std::bad_alloc());
+  if (fb->size) {
+    memcpy(new_buf + new_capacity - fb->size, fb->buf + fb->capacity - fb->size, fb->size);
+  }
+  free(fb->buf);
+  fb->buf = new_buf;
+  fb->capacity = new_capacity;
+}
+
+static void flatbuf_push(struct FlatBuilder *fb, const void *data, size_t n) {
+  if (n == 0) {
+    return;
+  }
+  flatbuf_reserve(fb, n);
+  fb->size += n;
+  memcpy(fb->buf + fb->capacity - fb->size, data, n);
+}
+
+// Pad so that the end of the next 'additional' bytes is aligned to 'align'
+static void flatbuf_align(struct FlatBuilder *fb, size_t align, size_t additional) {
+  fb->max_align = std::max(fb->max_align, align);
+  size_t pad = -(fb->size + additional) & (align - 1);
+  if (pad == 0) {
+    return;
+  }
+  flatbuf_reserve(fb, pad);
+  memset(fb->buf + fb->capacity - fb->size - pad, 0, pad);
+  fb->size += pad;
+}
+
+template <typename T> static void flatbuf_scalar(struct FlatBuilder *fb, T value) {
+  flatbuf_align(fb, sizeof(T), 0);
+  flatbuf_push(fb, &value, sizeof(T));
+}
+
+static void flatbuf_uoffset(struct FlatBuilder *fb, size_t ref) {
+  flatbuf_align(fb, 4, 0);
+  flatbuf_scalar<uint32_t>(fb, fb->size + 4 - ref);
+}
+
+static size_t flatbuf_string(struct FlatBuilder *fb, const char *s) {
+  size_t len = strlen(s);
+  flatbuf_align(fb, 4, len + 1);
+  flatbuf_push(fb, s, len + 1);
+  flatbuf_scalar<uint32_t>(fb, len);
+  return fb->size;
+}
+
+static size_t flatbuf_struct_vector(struct FlatBuilder *fb, const void *elems, size_t elem_size,
+                                    size_t n, size_t align) {
+  flatbuf_align(fb, 4, elem_size * n);
+  flatbuf_align(fb, align, elem_size * n);
+  flatbuf_push(fb, elems, elem_size * n);
+  flatbuf_scalar<uint32_t>(fb, n);
+  return fb->size;
+}
+
+static size_t flatbuf_offset_vector(struct FlatBuilder *fb, const size_t *refs, size_t n) {
+  flatbuf_align(fb, 4, 4 * n);
+  for (size_t i = n; i-- > 0;) {
+    flatbuf_uoffset(fb, refs[i]);
+  }
+  flatbuf_scalar<uint32_t>(fb, n);
+  return fb->size;
+}
+
+static void flatbuf_table_start(struct FlatBuilder *fb) {
+  fb->table_start = fb->size;
+  fb->n_fields = 0;
+  memset(fb->field_refs, 0, sizeof(fb->field_refs));
+}
+
+template <typename T> static void flatbuf_field(struct FlatBuilder *fb, size_t id, T value) {
+  flatbuf_scalar<T>(fb, value);
+  fb->field_refs[id] = fb->size;
+  fb->n_fields = std::max(fb->n_fields, id + 1);
+}
+
+static void flatbuf_field_offset(struct FlatBuilder *fb, size_t id, size_t ref) {
+  flatbuf_uoffset(fb, ref);
+  fb->field_refs[id] = fb->size;
+  fb->n_fields = std::max(fb->n_fields, id + 1);
+}
+
+static size_t flatbuf_table_end(struct FlatBuilder *fb) {
+  flatbuf_scalar<int32_t>(fb, 0); // Offset of the vtable, patched below
+  size_t table_ref = fb->size;
+  uint16_t vtable[2 + FLATBUF_MAX_FIELDS];
+  vtable[0] = (2 + fb->n_fields) * sizeof(uint16_t);
+  vtable[1] = table_ref - fb->table_start;
+  for (size_t i = 0; i < fb->n_fields; ++i) {
+    vtable[2 + i] = fb->field_refs[i] ? table_ref - fb->field_refs[i] : 0;
+  }
+  flatbuf_push(fb, vtable, vtable[0]);
+  int32_t vtable_offset = fb->size - table_ref;
+  memcpy(fb->buf + fb->capacity - table_ref, &vtable_offset, 4);
+  return table_ref;
+}
+
+// Return the finished buffer, which is valid until the builder is used again
+static const uint8_t *flatbuf_finish(struct FlatBuilder *fb, size_t root, size_t *len) {
+  flatbuf_align(fb, std::max<size_t>(fb->max_align, ARROW_IPC_ALIGNMENT), 4);
+  flatbuf_uoffset(fb, root);
+  *len = fb->size;
+  return fb->buf + fb->capacity - fb->size;
+}
+
+// Schema
+
+static size_t arrow_ipc_write_type(struct FlatBuilder *fb, const char *format,
+                                   enum ArrowIpcType *type) {
+  const char *ints = "cCsSiIlL";
+  const char *int_format = format[0] && !format[1] ? strchr(ints, format[0]) : NULL;
+  if (int_format != NULL) {
+    *type = arrow_ipc_type_int;
+    flatbuf_table_start(fb);
+    flatbuf_field<int32_t>(fb, 0, 8 << ((int_format - ints) / 2)); // bitWidth
+    flatbuf_field<uint8_t>(fb, 1, (int_format - ints) % 2 == 0);   // is_signed
+  } else if (!strcmp(format, "f") || !strcmp(format, "g")) {
+    *type = arrow_ipc_type_floating_point;
+    flatbuf_table_start(fb);
+    flatbuf_field<int16_t>(fb, 0, format[0] == 'f' ? 1 : 2); // precision: SINGLE/DOUBLE
+  } else if (!strcmp(format, "b")) {
+    *type = arrow_ipc_type_bool;
+    flatbuf_table_start(fb);
+  } else if (!strcmp(format, "tdD")) {
+    *type = arrow_ipc_type_date;
+    flatbuf_table_start(fb);
+    flatbuf_field<int16_t>(fb, 0, 0); // unit: DAY
+  } else if (!strcmp(format, "tss:")) {
+    *type = arrow_ipc_type_timestamp;
+    flatbuf_table_start(fb);
+    flatbuf_field<int16_t>(fb, 0, 0); // unit: SECOND
+  } else if (!strncmp(format, "w:", 2)) {
+    *type = arrow_ipc_type_fixed_size_binary;
+    flatbuf_table_start(fb);
+    flatbuf_field<int32_t>(fb, 0, atoi(format + 2)); // byteWidth
+  } else if (!strcmp(format, "U") || !strcmp(format, "Z")) {
+    *type = format[0] == 'U' ? arrow_ipc_type_large_utf8 : arrow_ipc_type_large_binary;
+    flatbuf_table_start(fb);
+  } else {
+    throw std::invalid_argument("Arrow format not supported by the IPC writer");
+  }
+  return flatbuf_table_end(fb);
+}
+
+static size_t arrow_ipc_write_schema(struct FlatBuilder *fb, const struct ArrowSchema *schema) {
+  size_t *field_refs = (size_t *)malloc(std::max<int64_t>(schema->n_children, 1) * sizeof(size_t));
+  assume(field_refs != NULL, std::bad_alloc());
+  size_t fields;
+  try {
+    for (int64_t i = 0; i < schema->n_children; ++i) {
+      const struct ArrowSchema *child = schema->children[i];
+      size_t name = flatbuf_string(fb, child->name ? child->name : "");
+      enum ArrowIpcType type_type;
+      size_t type = arrow_ipc_write_type(fb, child->format, &type_type);
+      size_t children = flatbuf_offset_vector(fb, NULL, 0);
+      flatbuf_table_start(fb);
+      flatbuf_field_offset(fb, 0, name);
+      flatbuf_field<uint8_t>(fb, 1, (child->flags & ARROW_FLAG_NULLABLE) != 0);
+      flatbuf_field<uint8_t>(fb, 2, type_type);
+      flatbuf_field_offset(fb, 3, type);
+      flatbuf_field_offset(fb, 5, children);
+      field_refs[i] = flatbuf_table_end(fb);
+    }
+    fields = flatbuf_offset_vector(fb, field_refs, schema->n_children);
+  } catch (...) {
+    free(field_refs);
+    throw;
+  }
+  free(field_refs);
+  flatbuf_table_start(fb);
+  flatbuf_field<int16_t>(fb, 0, 0); // endianness: Little
+  flatbuf_field_offset(fb, 1, fields);
+  return flatbuf_table_end(fb);
+}
+
+static size_t arrow_ipc_write_message(struct FlatBuilder *fb, enum ArrowIpcMessageHeader type,
+                                      size_t header, int64_t body_length) {
+  flatbuf_table_start(fb);
+  flatbuf_field<int64_t>(fb, 3, body_length);
+  flatbuf_field_offset(fb, 2, header);
+  flatbuf_field<int16_t>(fb, 0, ARROW_IPC_METADATA_V5);
+  flatbuf_field<uint8_t>(fb, 1, type);
+  return flatbuf_table_end(fb);
+}
+
+// Writer
+
+struct ArrowIpcWriter {
+  int fd;
+  size_t position;
+  struct ArrowSchema schema;
+  struct FlatBuilder fb;
+  struct ArrowIpcBlock *blocks;
+  size_t n_blocks, blocks_capacity;
+  // Of the current record batch
+  struct ArrowIpcFieldNode *nodes;
+  struct ArrowIpcBuffer *buffers;
+  const void **buffer_data;
+};
+
+static void arrow_ipc_write(struct ArrowIpcWriter *writer, const void *data, size_t len) {
+  const uint8_t *p = (const uint8_t *)data;
+  while (len > 0) {
+    ssize_t n = write(writer->fd, p, len);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    assume(n >= 0, std::system_error(errno, std::generic_category(), "Failed to write output file"));
+    p += n;
+    len -= n;
+    writer->position += n;
+  }
+}
+
+static void arrow_ipc_write_padding(struct ArrowIpcWriter *writer) {
+  static const uint8_t zeros[ARROW_IPC_ALIGNMENT] = {};
+  arrow_ipc_write(writer, zeros, -writer->position & (ARROW_IPC_ALIGNMENT - 1));
+}
+
+// Write an encapsulated message. Return its metadata length, including the prefix and padding.
+static size_t arrow_ipc_write_encapsulated(struct ArrowIpcWriter *writer, size_t root) {
+  size_t len;
+  const uint8_t *metadata = flatbuf_finish(&writer->fb, root, &len);
+  uint32_t prefix[2] = {ARROW_IPC_CONTINUATION, (uint32_t)len};
+  arrow_ipc_write(writer, prefix, sizeof(prefix));
+  arrow_ipc_write(writer, metadata, len);
+  return sizeof(prefix) + len;
+}
+
+size_t arrow_ipc_writer_struct_size() { return sizeof(struct ArrowIpcWriter); }
+
+void arrow_ipc_writer_init(struct ArrowIpcWriter *writer, int fd, const struct ArrowSchema *schema) {
+  assume(!strcmp(schema->format, "+s"), std::invalid_argument("Schema must be a struct"));
+  *writer = {};
+  writer->fd = fd;
+  size_t n_columns = std::max<int64_t>(schema->n_children, 1);
+  writer->nodes = (struct ArrowIpcFieldNode *)malloc(n_columns * sizeof(struct ArrowIpcFieldNode));
+  writer->buffers = (struct ArrowIpcBuffer *)malloc(3 * n_columns * sizeof(struct ArrowIpcBuffer));
+  writer->buffer_data = (const void **)malloc(3 * n_columns * sizeof(void *));
+  try {
+    assume(writer->nodes != NULL && writer->buffers != NULL && writer->buffer_data != NULL,
+           std::bad_alloc());
+    arrow_schema_deep_copy(schema, &writer->schema);
+    arrow_ipc_write(writer, "ARROW1\0\0", 8);
+    flatbuf_reset(&writer->fb);
+    size_t header = arrow_ipc_write_schema(&writer->fb, &writer->schema);
+    arrow_ipc_write_encapsulated(
+        writer, arrow_ipc_write_message(&writer->fb, arrow_ipc_header_schema, header, 0));
+  } catch (...) {
+    arrow_ipc_writer_deinit(writer);
+    throw;
+  }
+}
+
+void arrow_ipc_writer_deinit(struct ArrowIpcWriter *writer) {
+  if (writer->schema.release != NULL) {
+    writer->schema.release(&writer->schema);
+  }
+  free(writer->fb.buf);
+  free(writer->blocks);
+  free(writer->nodes);
+  free(writer->buffers);
+  free(writer->buffer_data);
+  *writer = {};
+}
+
+// Lengths of the buffers of an array without offset that was exported by an ArrowBatchBuilder
+static size_t arrow_ipc_buffer_lengths(const char *format, const struct ArrowArray *array,
+                                       size_t *lengths) {
+  size_t n = array->length;
+  lengths[0] = array->buffers[0] != NULL ? (n + 7) / 8 : 0;
+  if (!strcmp(format, "U") || !strcmp(format, "Z")) {
+    lengths[1] = (n + 1) * sizeof(int64_t);
+    lengths[2] = ((const int64_t *)array->buffers[1])[n];
+    return 3;
+  }
+  if (!strcmp(format, "b")) {
+    lengths[1] = (n + 7) / 8;
+  } else if (!strncmp(format, "w:", 2)) {
+    lengths[1] = n * atoi(format + 2);
+  } else if (strchr("cC", format[0])) {
+    lengths[1] = n;
+  } else if (strchr("sS", format[0])) {
+    lengths[1] = n * 2;
+  } else if (strchr("iIf", format[0]) || !strcmp(format, "tdD")) {
+    lengths[1] = n * 4;
+  } else {
+    lengths[1] = n * 8;
+  }
+  return 2;
+}
+
+void arrow_ipc_writer_write_batch(struct ArrowIpcWriter *writer, const struct ArrowArray *batch) {
+  int64_t n_columns = writer->schema.n_children;
+  assume(batch->n_children == n_columns && batch->offset == 0,
+         std::invalid_argument("Record batch does not match the schema"));
+  if (writer->n_blocks == writer->blocks_capacity) {
+    size_t new_capacity = std::max<size_t>(2 * writer->blocks_capacity, 16);
+    struct ArrowIpcBlock *new_blocks = (struct ArrowIpcBlock *)realloc(
+        writer->blocks, new_capacity * sizeof(struct ArrowIpcBlock));
+    assume(new_blocks != NULL, std::bad_alloc());
+    writer->blocks = new_blocks;
+    writer->blocks_capacity = new_capacity;
+  }
+
+  // Body layout
+  size_t n_buffers = 0;
+  int64_t body_length = 0;
+  for (int64_t i = 0; i < n_columns; ++i) {
+    const struct ArrowArray *column = batch->children[i];
+    writer->nodes[i] = {.length = column->length, .null_count = column->null_count};
+    size_t lengths[3];
+    size_t n = arrow_ipc_buffer_lengths(writer->schema.children[i]->format, column, lengths);
+    for (size_t k = 0; k < n; ++k, ++n_buffers) {
+      writer->buffers[n_buffers] = {.offset = body_length, .length = (int64_t)lengths[k]};
+      writer->buffer_data[n_buffers] = column->buffers[k];
+      body_length += (lengths[k] + ARROW_IPC_ALIGNMENT - 1) & -ARROW_IPC_ALIGNMENT;
+    }
+  }
+
+  struct FlatBuilder *fb = &writer->fb;
+  flatbuf_reset(fb);
+  size_t buffers = flatbuf_struct_vector(fb, writer->buffers, sizeof(struct ArrowIpcBuffer),
+                                         n_buffers, alignof(struct ArrowIpcBuffer));
+  size_t nodes = flatbuf_struct_vector(fb, writer->nodes, sizeof(struct ArrowIpcFieldNode),
+                                       n_columns, alignof(struct ArrowIpcFieldNode));
+  flatbuf_table_start(fb);
+  flatbuf_field<int64_t>(fb, 0, batch->length);
+  flatbuf_field_offset(fb, 1, nodes);
+  flatbuf_field_offset(fb, 2, buffers);
+  size_t header = flatbuf_table_end(fb);
+
+  struct ArrowIpcBlock *block = &writer->blocks[writer->n_blocks];
+  *block = {.offset = (int64_t)writer->position,
+            .metadata_length = 0, // Set below, once the message has been written
+            .padding = 0,
+            .body_length = body_length};
+  block->metadata_length = arrow_ipc_write_encapsulated(
+      writer, arrow_ipc_write_message(fb, arrow_ipc_header_record_batch, header, body_length));
+  for (size_t k = 0; k < n_buffers; ++k) {
+    arrow_ipc_write(writer, writer->buffer_data[k], writer->buffers[k].length);
+    arrow_ipc_write_padding(writer);
+  }
+  ++writer->n_blocks;
+}
+
+void arrow_ipc_writer_finish(struct ArrowIpcWriter *writer) {
+  uint32_t eos[2] = {ARROW_IPC_CONTINUATION, 0};
+  arrow_ipc_write(writer, eos, sizeof(eos));
+
+  struct FlatBuilder *fb = &writer->fb;
+  flatbuf_reset(fb);
+  size_t record_batches =
+      flatbuf_struct_vector(fb, writer->blocks, sizeof(struct ArrowIpcBlock), writer->n_blocks,
+                            alignof(struct ArrowIpcBlock));
+  size_t dictionaries = flatbuf_struct_vector(fb, NULL, sizeof(struct ArrowIpcBlock), 0,
+                                              alignof(struct ArrowIpcBlock));
+  size_t schema = arrow_ipc_write_schema(fb, &writer->schema);
+  flatbuf_table_start(fb);
+  flatbuf_field_offset(fb, 1, schema);
+  flatbuf_field_offset(fb, 2, dictionaries);
+  flatbuf_field_offset(fb, 3, record_batches);
+  flatbuf_field<int16_t>(fb, 0, ARROW_IPC_METADATA_V5);
+  size_t len;
+  const uint8_t *footer = flatbuf_finish(fb, flatbuf_table_end(fb), &len);
+  arrow_ipc_write(writer, footer, len);
+  int32_t footer_len = len;
+  arrow_ipc_write(writer, &footer_len, sizeof(footer_len));
+  arrow_ipc_write(writer, "ARROW1", 6);
+}
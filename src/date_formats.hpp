@@ -0,0 +1,91 @@
+#ifndef DATE_FORMATS_HPP
+#define DATE_FORMATS_HPP
+#include <string.h>
+#include <string>
+
+#include "../include/sas7bdat.hpp"
+#include "hash.hpp"
+
+// Names of SAS formats of date and datetime columns, looked up with a perfect hash that is
+// computed at compile time.
+
+struct DateFormatName {
+  const char *name;
+  enum ColumnFormat format;
+};
+
+#define D(name) {name, column_format_date}
+#define DT(name) {name, column_format_datetime}
+static constexpr struct DateFormatName SAS_DATE_FORMAT_NAMES[] = {
+    D("DATE"),      D("DAY"),       D("DDMMYY"),    D("DOWNAME"),   D("JULDAY"),
+    D("JULIAN"),    D("MMDDYY"),    D("MMYY"),      D("MMYYC"),     D("MMYYD"),
+    D("MMYYP"),     D("MMYYS"),     D("MMYYN"),     D("MONNAME"),   D("MONTH"),
+    D("MONYY"),     D("QTR"),       D("QTRR"),      D("NENGO"),     D("WEEKDATE"),
+    D("WEEKDATX"),  D("WEEKDAY"),   D("WEEKV"),     D("WORDDATE"),  D("WORDDATX"),
+    D("YEAR"),      D("YYMM"),      D("YYMMC"),     D("YYMMD"),     D("YYMMP"),
+    D("YYMMS"),     D("YYMMN"),     D("YYMON"),     D("YYMMDD"),    D("YYQ"),
+    D("YYQC"),      D("YYQD"),      D("YYQP"),      D("YYQS"),      D("YYQN"),
+    D("YYQR"),      D("YYQRC"),     D("YYQRD"),     D("YYQRP"),     D("YYQRS"),
+    D("YYQRN"),     D("YYMMDDP"),   D("YYMMDDC"),   D("E8601DA"),   D("YYMMDDN"),
+    D("MMDDYYC"),   D("MMDDYYS"),   D("MMDDYYD"),   D("YYMMDDS"),   D("B8601DA"),
+    D("DDMMYYN"),   D("YYMMDDD"),   D("DDMMYYB"),   D("DDMMYYP"),   D("MMDDYYP"),
+    D("YYMMDDB"),   D("MMDDYYN"),   D("DDMMYYC"),   D("DDMMYYD"),   D("DDMMYYS"),
+    D("MINGUO"),    DT("DATETIME"), DT("DTWKDATX"), DT("B8601DN"),  DT("B8601DT"),
+    DT("B8601DX"),  DT("B8601DZ"),  DT("B8601LX"),  DT("E8601DN"),  DT("E8601DT"),
+    DT("E8601DX"),  DT("E8601DZ"),  DT("E8601LX"),  DT("DATEAMPM"), DT("DTDATE"),
+    DT("DTMONYY"),  DT("DTYEAR"),   DT("TOD"),      DT("MDYAMPM"),
+};
+#undef D
+#undef DT
+
+#define N_DATE_FORMAT_NAMES (sizeof(SAS_DATE_FORMAT_NAMES) / sizeof(SAS_DATE_FORMAT_NAMES[0]))
+#define DATE_FORMAT_TABLE_SIZE 1024
+#define DATE_FORMAT_MAX_SEEDS 100000
+
+struct DateFormatTable {
+  uint64_t seed;
+  uint8_t slots[DATE_FORMAT_TABLE_SIZE]; // 1 + index into SAS_DATE_FORMAT_NAMES, 0 if empty
+};
+
+static constexpr size_t date_format_slot(const char *name, size_t len, uint64_t seed) {
+  uint64_t hash = fnv1a(name, len, FNV1A_OFFSET_BASIS ^ seed);
+  return (hash ^ (hash >> 32)) % DATE_FORMAT_TABLE_SIZE;
+}
+
+// Find the first seed that maps all names to different slots
+static constexpr struct DateFormatTable build_date_format_table() {
+  for (uint64_t seed = 0; seed < DATE_FORMAT_MAX_SEEDS; ++seed) {
+    struct DateFormatTable table = {.seed = seed, .slots = {}};
+    bool collision = false;
+    for (size_t i = 0; !collision && i < N_DATE_FORMAT_NAMES; ++i) {
+      const char *name = SAS_DATE_FORMAT_NAMES[i].name;
+      size_t slot = date_format_slot(name, std::char_traits<char>::length(name), seed);
+      collision = table.slots[slot] != 0;
+      table.slots[slot] = i + 1;
+    }
+    if (!collision) {
+      return table;
+    }
+  }
+  return {.seed = DATE_FORMAT_MAX_SEEDS, .slots = {}};
+}
+
+static constexpr struct DateFormatTable date_format_table = build_date_format_table();
+static_assert(date_format_table.seed < DATE_FORMAT_MAX_SEEDS,
+              "No perfect hash for date format names, duplicate name?");
+static_assert(N_DATE_FORMAT_NAMES < 256);
+
+// column_format_date, column_format_datetime, or column_format_none for other formats
+static enum ColumnFormat lookup_date_format(const char *name, size_t len) {
+  uint8_t idx = date_format_table.slots[date_format_slot(name, len, date_format_table.seed)];
+  if (idx == 0) {
+    return column_format_none;
+  }
+  const struct DateFormatName *candidate = &SAS_DATE_FORMAT_NAMES[idx - 1];
+  if (strlen(candidate->name) != len || memcmp(candidate->name, name, len)) {
+    return column_format_none;
+  }
+  return candidate->format;
+}
+
+#endif
@@ -0,0 +1,139 @@
+#ifndef DECIMAL_BATCH_HPP
+#define DECIMAL_BATCH_HPP
+#include <algorithm>
+#include <stdint.h>
+#include <string.h>
+
+#include "../include/sas7bdat.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// Batch version of decimal2double() for a column slice: decodes the 'len'-byte numbers at
+// first + r * stride, r < n, to out[r].
+//
+// Numbers are read with (possibly overlapping) 8-byte loads, then widened to doubles and
+// byteswapped in one step: a single byte shuffle with AVX2, a shift or byteswap-and-mask
+// otherwise. 8-byte loads are only used where they stay within the slice
+// [first, first + (n - 1) * stride + len); the remaining rows use decimal2double().
+
+static size_t decimal_batch_safe_rows(size_t n, size_t stride, size_t len) {
+  // Row r is safe if r * stride + 8 <= (n - 1) * stride + len
+  if (n == 0) {
+    return 0;
+  }
+  size_t end = (n - 1) * stride + len;
+  return end < 8 ? 0 : std::min(n, (end - 8) / stride + 1);
+}
+
+template <size_t len, bool file_is_little_endian>
+static void decimal2double_batch_scalar(const uint8_t *first, size_t n, size_t stride,
+                                        double *out) {
+  static_assert(len >= 3 && len <= 8);
+  for (size_t r = 0; r < n; ++r) {
+    uint64_t v;
+    memcpy(&v, first + r * stride, 8);
+    if (file_is_little_endian) {
+      v <<= 64 - 8 * len;
+    } else {
+      v = __builtin_bswap64(v);
+      if (len < 8) {
+        v &= ~(((uint64_t)1 << (64 - 8 * len)) - 1);
+      }
+    }
+    memcpy(&out[r], &v, 8);
+  }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+// Shuffle mask that moves the 'len' bytes of a number to the top of its 64-bit lane, reversing
+// them for big-endian files, and zeroes the other bytes (mask byte 0x80)
+template <size_t len, bool file_is_little_endian>
+static constexpr uint64_t decimal_shuffle_mask() {
+  uint64_t mask = 0;
+  for (size_t j = 0; j < 8; ++j) {
+    uint64_t src = 0x80;
+    if (j >= 8 - len) {
+      src = file_is_little_endian ? j - (8 - len) : 7 - j;
+    }
+    mask |= src << (8 * j);
+  }
+  return mask;
+}
+
+template <size_t len, bool file_is_little_endian>
+__attribute__((target("avx2"))) static void
+decimal2double_batch_avx2(const uint8_t *first, size_t n, size_t stride, double *out) {
+  constexpr uint64_t mask64 = decimal_shuffle_mask<len, file_is_little_endian>();
+  // _mm256_shuffle_epi8 shuffles within 128-bit halves; lane indices are relative to the lane
+  const __m256i mask = _mm256_set_epi64x(mask64 + 0x0808080808080808, mask64,
+                                         mask64 + 0x0808080808080808, mask64);
+  size_t r = 0;
+  for (; r + 4 <= n; r += 4) {
+    const uint8_t *src = first + r * stride;
+    uint64_t v0, v1, v2, v3;
+    memcpy(&v0, src, 8);
+    memcpy(&v1, src + stride, 8);
+    memcpy(&v2, src + 2 * stride, 8);
+    memcpy(&v3, src + 3 * stride, 8);
+    __m256i v = _mm256_set_epi64x(v3, v2, v1, v0);
+    _mm256_storeu_si256((__m256i *)&out[r], _mm256_shuffle_epi8(v, mask));
+  }
+  decimal2double_batch_scalar<len, file_is_little_endian>(first + r * stride, n - r, stride,
+                                                          &out[r]);
+}
+
+#endif
+
+template <size_t len, bool file_is_little_endian>
+static void decimal2double_batch_fast(const uint8_t *first, size_t n, size_t stride, double *out) {
+#if defined(__x86_64__) || defined(__i386__)
+  static const bool have_avx2 = __builtin_cpu_supports("avx2");
+  if (have_avx2) {
+    decimal2double_batch_avx2<len, file_is_little_endian>(first, n, stride, out);
+    return;
+  }
+#endif
+  decimal2double_batch_scalar<len, file_is_little_endian>(first, n, stride, out);
+}
+
+template <bool file_is_little_endian>
+static void decimal2double_batch_endian(const uint8_t *first, size_t n, size_t stride, size_t len,
+                                        double *out) {
+  switch (len) {
+  case 3:
+    return decimal2double_batch_fast<3, file_is_little_endian>(first, n, stride, out);
+  case 4:
+    return decimal2double_batch_fast<4, file_is_little_endian>(first, n, stride, out);
+  case 5:
+    return decimal2double_batch_fast<5, file_is_little_endian>(first, n, stride, out);
+  case 6:
+    return decimal2double_batch_fast<6, file_is_little_endian>(first, n, stride, out);
+  case 7:
+    return decimal2double_batch_fast<7, file_is_little_endian>(first, n, stride, out);
+  case 8:
+    return decimal2double_batch_fast<8, file_is_little_endian>(first, n, stride, out);
+  default:
+    __builtin_unreachable();
+  }
+}
+
+static void decimal2double_batch(const uint8_t *first, size_t n, size_t stride, size_t len,
+                                 bool file_is_little_endian, double *out) {
+  size_t n_fast = 0;
+  if (machine_is_little_endian()) {
+    n_fast = decimal_batch_safe_rows(n, stride, len);
+    if (file_is_little_endian) {
+      decimal2double_batch_endian<true>(first, n_fast, stride, len, out);
+    } else {
+      decimal2double_batch_endian<false>(first, n_fast, stride, len, out);
+    }
+  }
+  for (size_t r = n_fast; r < n; ++r) {
+    decimal2double(first + r * stride, len, file_is_little_endian, &out[r]);
+  }
+}
+
+#endif
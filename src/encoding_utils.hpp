@@ -1,19 +1,20 @@
 #ifndef ENCODING_UTILS_HPP
 #define ENCODING_UTILS_HPP
 #include "../include/sas7bdat.hpp"
+#include <initializer_list>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 static bool is_ascii(uint8_t c) {
   return !(c & 0x80);
 }
 
-static bool is_ascii_8(uint64_t cs) {
-  return !(cs & 0x8080808080808080ull);
-}
-
-static bool maybe_iso_8859_15_8(uint64_t cs) {
-  return cs & 0xa0a0a0a0a0a0a0a0ull;
-}
-
 static bool is_iso_8859_15(uint8_t c) {
   switch (c) {
   case 0xa4:
@@ -33,64 +34,129 @@ static bool is_windows_1252(uint8_t c) {
   return c >= 0x80 && c <= 0x9f;
 }
 
-enum Encoding detect_iso_8859_15_variant(const uint8_t *s, size_t len) {
-  const uint8_t *end = &s[len];
-
-  if (len >= 8) {
-    const uint8_t *s_aligned = (uint8_t *)((size_t)s & -8);
-    for (; s < s_aligned; ++s) {
-      if (!is_ascii(*s)) {
-        for (; s < s_aligned; ++s) {
-          if (is_iso_8859_15(*s)) {
-            return encoding_iso_8859_15;
-          }
-        }
-        return encoding_iso_8859_1;
-      }
-    }
+// Kinds of non-ASCII bytes in a string, to pick one decoder for a whole column chunk
+#define BYTE_CLASS_NON_ASCII 1
+#define BYTE_CLASS_WINDOWS_1252 2 // 0x80...0x9f, control characters in ISO-8859-1/15
+#define BYTE_CLASS_ISO_8859_15 4  // Differ between ISO-8859-1 and ISO-8859-15
 
-    for (; s + 8 < end; s += 8) {
-      if (!is_ascii_8(*(uint64_t *)s)) {
-        for (; s + 8 < end; s += 8) {
-          if (maybe_iso_8859_15_8(*(uint64_t *)s)) {
-            for (size_t i = 0; i < 8; ++i) {
-              if (is_iso_8859_15(s[i])) {
-                return encoding_iso_8859_15;
-              }
-            }
-          }
-        }
-        return encoding_iso_8859_1;
-      }
-    }
+#if defined(__x86_64__) || defined(__i386__)
+
+static unsigned classify_bytes_16(const uint8_t *s) {
+  __m128i v = _mm_loadu_si128((const __m128i *)s);
+  if (!_mm_movemask_epi8(v)) {
+    return 0;
   }
+  unsigned classes = BYTE_CLASS_NON_ASCII;
+  __m128i c1 = _mm_cmpeq_epi8(_mm_and_si128(v, _mm_set1_epi8((char)0xe0)),
+                              _mm_set1_epi8((char)0x80));
+  if (_mm_movemask_epi8(c1)) {
+    classes |= BYTE_CLASS_WINDOWS_1252;
+  }
+  __m128i iso = _mm_setzero_si128();
+  for (uint8_t c : {0xa4, 0xa6, 0xa8, 0xb4, 0xb8, 0xbc, 0xbd, 0xbe}) {
+    iso = _mm_or_si128(iso, _mm_cmpeq_epi8(v, _mm_set1_epi8((char)c)));
+  }
+  if (_mm_movemask_epi8(iso)) {
+    classes |= BYTE_CLASS_ISO_8859_15;
+  }
+  return classes;
+}
+
+#elif defined(__aarch64__) && defined(__ARM_NEON)
 
-  for (; s < end; ++s) {
-    if (!is_ascii(*s)) {
-      for (; s < end; ++s) {
-        if (is_iso_8859_15(*s)) {
-          return encoding_iso_8859_15;
-        }
-      }
-      return encoding_iso_8859_1;
+static unsigned classify_bytes_16(const uint8_t *s) {
+  uint8x16_t v = vld1q_u8(s);
+  if (vmaxvq_u8(v) < 0x80) {
+    return 0;
+  }
+  unsigned classes = BYTE_CLASS_NON_ASCII;
+  if (vmaxvq_u8(vceqq_u8(vandq_u8(v, vdupq_n_u8(0xe0)), vdupq_n_u8(0x80)))) {
+    classes |= BYTE_CLASS_WINDOWS_1252;
+  }
+  uint8x16_t iso = vdupq_n_u8(0);
+  for (uint8_t c : {0xa4, 0xa6, 0xa8, 0xb4, 0xb8, 0xbc, 0xbd, 0xbe}) {
+    iso = vorrq_u8(iso, vceqq_u8(v, vdupq_n_u8(c)));
+  }
+  if (vmaxvq_u8(iso)) {
+    classes |= BYTE_CLASS_ISO_8859_15;
+  }
+  return classes;
+}
+
+#else
+
+static unsigned classify_bytes_16(const uint8_t *s) {
+  unsigned classes = 0;
+  for (size_t i = 0; i < 16; ++i) {
+    if (!is_ascii(s[i])) {
+      classes |= BYTE_CLASS_NON_ASCII;
+      classes |= is_windows_1252(s[i]) ? BYTE_CLASS_WINDOWS_1252 : 0;
+      classes |= is_iso_8859_15(s[i]) ? BYTE_CLASS_ISO_8859_15 : 0;
     }
   }
+  return classes;
+}
 
-  return encoding_ascii;
+#endif
+
+static unsigned classify_bytes(const uint8_t *s, size_t len) {
+  unsigned classes = 0;
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    classes |= classify_bytes_16(&s[i]);
+  }
+  if (i < len) {
+    // Zero padding is ASCII
+    uint8_t tail[16] = {};
+    memcpy(tail, &s[i], len - i);
+    classes |= classify_bytes_16(tail);
+  }
+  return classes;
 }
 
-enum Encoding detect_windows_1252_variant(const uint8_t *s, size_t len) {
-  // todo vectorize
-  const uint8_t *end = &s[len];
-  enum Encoding res = encoding_ascii;
-  for (; s < end; ++s) {
-    if (is_windows_1252(*s)) {
-      return encoding_windows_1252;
-    } else if (!is_ascii(*s)) {
-      res = encoding_iso_8859_1;
-    }
+static enum Encoding detect_iso_8859_15_variant(const uint8_t *s, size_t len) {
+  unsigned classes = classify_bytes(s, len);
+  return classes & BYTE_CLASS_ISO_8859_15 ? encoding_iso_8859_15
+         : classes & BYTE_CLASS_NON_ASCII ? encoding_iso_8859_1
+                                          : encoding_ascii;
+}
+
+static enum Encoding detect_windows_1252_variant(const uint8_t *s, size_t len) {
+  unsigned classes = classify_bytes(s, len);
+  return classes & BYTE_CLASS_WINDOWS_1252 ? encoding_windows_1252
+         : classes & BYTE_CLASS_NON_ASCII  ? encoding_iso_8859_1
+                                           : encoding_ascii;
+}
+
+// Classes of the bytes of a column chunk, 'len' bytes at first_cell + k * stride for each row k.
+// Stops early once any of the 'stop' classes is seen.
+static unsigned classify_column(const uint8_t *first_cell, size_t n_rows, size_t stride,
+                                size_t len, unsigned stop) {
+  unsigned classes = 0;
+  const uint8_t *cell = first_cell;
+  for (size_t r = 0; r < n_rows && !(classes & stop); ++r, cell += stride) {
+    classes |= classify_bytes(cell, len);
+  }
+  return classes;
+}
+
+// Decoder for all cells of a column chunk. Gives the same strings as the per-cell
+// detect_*_variant(), because the candidate encodings agree on all bytes that do not decide
+// between them.
+static enum Encoding detect_column_encoding(enum Encoding encoding, const uint8_t *first_cell,
+                                            size_t n_rows, size_t stride, size_t len) {
+  unsigned decisive = encoding == encoding_windows_1252  ? BYTE_CLASS_WINDOWS_1252
+                      : encoding == encoding_iso_8859_15 ? BYTE_CLASS_ISO_8859_15
+                                                         : BYTE_CLASS_NON_ASCII;
+  unsigned classes = classify_column(first_cell, n_rows, stride, len, decisive);
+  if (!(classes & BYTE_CLASS_NON_ASCII)) {
+    // All encodings we support are ASCII compatible
+    return encoding_ascii;
+  }
+  if (encoding == encoding_windows_1252 || encoding == encoding_iso_8859_15) {
+    return classes & decisive ? encoding : encoding_iso_8859_1;
   }
-  return res;
+  return encoding;
 }
 
 #endif
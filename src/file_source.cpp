@@ -0,0 +1,218 @@
+#include <algorithm>
+#include <condition_variable>
+#include <errno.h>
+#include <mutex>
+#include <new>
+#include <string.h>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+
+#include "../include/sas7bdat.hpp"
+#include "assume.hpp"
+
+// Block b of the file, [b * buffer_size, (b + 1) * buffer_size), lives in slot b % n_buffers.
+// The parser always uses the slot of block 'wanted_block', and the readahead thread fills the
+// slots of the following n_buffers - 1 blocks.
+struct FileSourceSlot {
+  uint8_t *buf;
+  size_t block;
+  size_t len;
+  int error;
+  bool ready;
+};
+
+struct FileSource {
+  int fd;
+  size_t file_size;
+  size_t buffer_size;
+  size_t n_buffers;
+  struct FileSourceSlot *slots;
+  // For requests that span two or more blocks
+  uint8_t *stitch_buf;
+  size_t stitch_buf_size;
+  std::mutex lock;
+  std::condition_variable cond;
+  size_t wanted_block;
+  bool stop;
+  std::thread readahead_thread;
+};
+
+static void file_source_pread(int fd, uint8_t *buf, size_t len, size_t offset, size_t *n_read,
+                              int *error) {
+  *n_read = 0;
+  *error = 0;
+  while (*n_read < len) {
+    ssize_t n = pread(fd, &buf[*n_read], len - *n_read, offset + *n_read);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    } else if (n < 0) {
+      *error = errno;
+      return;
+    } else if (n == 0) {
+      return;
+    }
+    *n_read += n;
+  }
+}
+
+static bool file_source_next_block_to_read(const struct FileSource *source, size_t *block) {
+  for (size_t i = 0; i < source->n_buffers; ++i) {
+    size_t candidate = source->wanted_block + i;
+    if (candidate * source->buffer_size >= source->file_size) {
+      break;
+    }
+    const struct FileSourceSlot *slot = &source->slots[candidate % source->n_buffers];
+    if (slot->block != candidate) {
+      *block = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+static void file_source_readahead(struct FileSource *source) {
+  std::unique_lock<std::mutex> guard(source->lock);
+  while (!source->stop) {
+    size_t block;
+    if (!file_source_next_block_to_read(source, &block)) {
+      source->cond.wait(guard);
+      continue;
+    }
+    struct FileSourceSlot *slot = &source->slots[block % source->n_buffers];
+    slot->block = block;
+    slot->ready = false;
+    guard.unlock();
+    size_t len, offset = block * source->buffer_size;
+    int error;
+    file_source_pread(source->fd, slot->buf,
+                      std::min(source->buffer_size, source->file_size - offset), offset, &len,
+                      &error);
+    guard.lock();
+    slot->len = len;
+    slot->error = error;
+    slot->ready = true;
+    source->cond.notify_all();
+  }
+}
+
+size_t file_source_struct_size() {
+  return sizeof(struct FileSource);
+}
+
+void file_source_init(struct FileSource *source, int fd, size_t file_size, size_t buffer_size,
+                      size_t n_buffers) {
+  assume(buffer_size > 0, std::invalid_argument("buffer_size must be > 0"));
+  assume(n_buffers >= 2, std::invalid_argument("n_buffers must be >= 2"));
+  new (source) FileSource();
+  source->fd = fd;
+  source->file_size = file_size;
+  source->buffer_size = buffer_size;
+  source->n_buffers = n_buffers;
+  source->slots = (struct FileSourceSlot *)calloc(n_buffers, sizeof(struct FileSourceSlot));
+  bool ok = source->slots != NULL;
+  for (size_t i = 0; ok && i < n_buffers; ++i) {
+    source->slots[i].block = SIZE_MAX;
+    source->slots[i].buf = (uint8_t *)malloc(buffer_size);
+    ok = source->slots[i].buf != NULL;
+  }
+  if (ok) {
+    try {
+      source->readahead_thread = std::thread(file_source_readahead, source);
+    } catch (...) {
+      ok = false;
+    }
+  }
+  if (!ok) {
+    file_source_deinit(source);
+    throw std::bad_alloc();
+  }
+}
+
+void file_source_deinit(struct FileSource *source) {
+  {
+    std::lock_guard<std::mutex> guard(source->lock);
+    source->stop = true;
+  }
+  source->cond.notify_all();
+  if (source->readahead_thread.joinable()) {
+    source->readahead_thread.join();
+  }
+  for (size_t i = 0; source->slots != NULL && i < source->n_buffers; ++i) {
+    free(source->slots[i].buf);
+  }
+  free(source->slots);
+  free(source->stitch_buf);
+  source->~FileSource();
+}
+
+// Make 'block' the parser's block and wait until it has been read. Its slot is not reused until
+// the parser asks for another block.
+static const struct FileSourceSlot *file_source_wait_for_block(struct FileSource *source,
+                                                               size_t block) {
+  std::unique_lock<std::mutex> guard(source->lock);
+  source->wanted_block = block;
+  source->cond.notify_all();
+  const struct FileSourceSlot *slot = &source->slots[block % source->n_buffers];
+  source->cond.wait(guard, [&] { return slot->block == block && slot->ready; });
+  if (slot->error) {
+    throw std::system_error(slot->error, std::generic_category(), "Failed to read input file");
+  }
+  return slot;
+}
+
+void file_source_on_pagefault(void *userdata, size_t requested_data_start,
+                              size_t requested_data_len, size_t *new_data_offset,
+                              const uint8_t **new_data, size_t *new_data_len) {
+  struct FileSource *source = (struct FileSource *)userdata;
+  assume(requested_data_start < source->file_size,
+         sas7bdat_error("Failed to read more data, truncated input file?"));
+  size_t requested_data_end = requested_data_start + requested_data_len;
+  if (requested_data_end > source->file_size || requested_data_end < requested_data_start) {
+    requested_data_end = source->file_size;
+  }
+  size_t block = requested_data_start / source->buffer_size;
+
+  if ((requested_data_end - 1) / source->buffer_size != block) {
+    // Spans two or more blocks: copy them from their slots into the stitch buffer, one block
+    // after the other, so that the readahead thread keeps reading ahead of the parser
+    size_t len = requested_data_end - requested_data_start;
+    if (source->stitch_buf_size < len) {
+      uint8_t *stitch_buf = (uint8_t *)realloc(source->stitch_buf, len);
+      assume(stitch_buf != NULL, std::bad_alloc());
+      source->stitch_buf = stitch_buf;
+      source->stitch_buf_size = len;
+    }
+    size_t n_copied = 0;
+    while (n_copied < len) {
+      size_t offset = requested_data_start + n_copied;
+      const struct FileSourceSlot *slot =
+          file_source_wait_for_block(source, offset / source->buffer_size);
+      size_t slot_offset = offset % source->buffer_size;
+      if (slot->len <= slot_offset) {
+        break;
+      }
+      size_t n = std::min(len - n_copied, slot->len - slot_offset);
+      memcpy(&source->stitch_buf[n_copied], &slot->buf[slot_offset], n);
+      n_copied += n;
+      if (slot->len < source->buffer_size) {
+        // Short read: the file ends in this block
+        break;
+      }
+    }
+    assume(n_copied > 0, sas7bdat_error("Failed to read more data, truncated input file?"));
+    *new_data = source->stitch_buf;
+    *new_data_offset = 0;
+    *new_data_len = n_copied;
+    return;
+  }
+
+  const struct FileSourceSlot *slot = file_source_wait_for_block(source, block);
+  size_t block_start = block * source->buffer_size;
+  *new_data = slot->buf;
+  *new_data_offset = requested_data_start - block_start;
+  // The file may have been truncated after file_size was determined
+  assume(slot->len > *new_data_offset,
+         sas7bdat_error("Failed to read more data, truncated input file?"));
+  *new_data_len = slot->len - *new_data_offset;
+}
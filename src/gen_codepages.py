@@ -0,0 +1,112 @@
+"""Generate codepages.hpp, the tables of the single-byte encodings of enum Encoding.
+
+Tables are taken from Python's codecs, or from glibc's iconv for the code pages Python does
+not have. Bytes that are undefined in an encoding map to U+FFFD. Usage:
+
+    python gen_codepages.py > codepages.hpp
+"""
+import subprocess
+import sys
+
+# enum Encoding suffix, Python codec, iconv name
+CODEPAGES = [
+    ("iso_8859_1", "iso8859_1", "ISO-8859-1"),
+    ("iso_8859_2", "iso8859_2", "ISO-8859-2"),
+    ("iso_8859_3", "iso8859_3", "ISO-8859-3"),
+    ("iso_8859_4", "iso8859_4", "ISO-8859-4"),
+    ("iso_8859_5", "iso8859_5", "ISO-8859-5"),
+    ("iso_8859_6", "iso8859_6", "ISO-8859-6"),
+    ("iso_8859_7", "iso8859_7", "ISO-8859-7"),
+    ("iso_8859_8", "iso8859_8", "ISO-8859-8"),
+    ("iso_8859_9", "iso8859_9", "ISO-8859-9"),
+    ("iso_8859_11", "iso8859_11", "ISO-8859-11"),
+    ("iso_8859_13", "iso8859_13", "ISO-8859-13"),
+    ("iso_8859_14", "iso8859_14", "ISO-8859-14"),
+    ("iso_8859_15", "iso8859_15", "ISO-8859-15"),
+    ("cp437", "cp437", "CP437"),
+    ("cp720", "cp720", None),
+    ("cp737", "cp737", "CP737"),
+    ("cp775", "cp775", "CP775"),
+    ("cp850", "cp850", "CP850"),
+    ("cp852", "cp852", "CP852"),
+    ("cp857", "cp857", "CP857"),
+    ("cp858", "cp858", "CP858"),
+    ("cp860", "cp860", "CP860"),
+    ("cp862", "cp862", "CP862"),
+    ("cp863", "cp863", "CP863"),
+    ("cp864", "cp864", "CP864"),
+    ("cp865", "cp865", "CP865"),
+    ("cp866", "cp866", "CP866"),
+    ("cp869", "cp869", "CP869"),
+    ("cp874", "cp874", "CP874"),
+    ("cp921", None, "CP921"),
+    ("cp922", None, "CP922"),
+    ("cp1129", None, "CP1129"),
+    ("windows_1250", "cp1250", "CP1250"),
+    ("windows_1251", "cp1251", "CP1251"),
+    ("windows_1252", "cp1252", "CP1252"),
+    ("windows_1253", "cp1253", "CP1253"),
+    ("windows_1254", "cp1254", "CP1254"),
+    ("windows_1255", "cp1255", "CP1255"),
+    ("windows_1256", "cp1256", "CP1256"),
+    ("windows_1257", "cp1257", "CP1257"),
+    ("windows_1258", "cp1258", "CP1258"),
+    ("macroman", "mac_roman", None),
+    ("macarabic", "mac_arabic", None),
+    ("macgreek", "mac_greek", None),
+    ("macturkish", "mac_turkish", None),
+    ("macukraine", None, "MAC-UK"),
+    ("maciceland", "mac_iceland", None),
+    ("maccroatian", "mac_croatian", None),
+    ("maccyrillic", "mac_cyrillic", None),
+    ("macromania", "mac_romanian", None),
+]
+
+# Encodings that SAS also writes as their Windows-1252 superset
+ALIASES = {"windows_1252": ["default", "any"]}
+
+
+def decode_byte(python_codec, iconv_name, byte):
+    if python_codec is not None:
+        return bytes([byte]).decode(python_codec, errors="replace")
+    result = subprocess.run(
+        ["iconv", "-f", iconv_name, "-t", "UTF-8"], input=bytes([byte]), capture_output=True
+    )
+    return result.stdout.decode() if result.returncode == 0 else "\ufffd"
+
+
+def high_codepoints(python_codec, iconv_name):
+    # Only the upper half: all encodings we support are treated as ASCII compatible, even
+    # cp864, which has an Arabic percent sign at 0x25
+    codepoints = []
+    for byte in range(0x80, 0x100):
+        char = decode_byte(python_codec, iconv_name, byte)
+        assert len(char) == 1 and ord(char) <= 0xFFFF, (python_codec, iconv_name, byte)
+        codepoints.append(ord(char))
+    return codepoints
+
+
+def main(out):
+    out.write("// Generated by gen_codepages.py, do not edit\n")
+    out.write("#ifndef CODEPAGES_HPP\n#define CODEPAGES_HPP\n")
+    out.write('#include <stdint.h>\n\n#include "../include/sas7bdat.hpp"\n\n')
+    out.write("// Code points of bytes 0x80...0xff of single-byte encodings\n")
+    out.write("struct SingleByteCodepage {\n  uint16_t high[128];\n};\n")
+    for name, python_codec, iconv_name in CODEPAGES:
+        codepoints = high_codepoints(python_codec, iconv_name)
+        out.write(f"\nstatic constexpr struct SingleByteCodepage CODEPAGE_{name.upper()} = {{{{\n")
+        for i in range(0, 128, 8):
+            out.write("    " + " ".join(f"0x{c:04x}," for c in codepoints[i : i + 8]) + "\n")
+        out.write("}};\n")
+    out.write("\n// NULL if 'encoding' is not a supported single-byte encoding\n")
+    out.write("static const struct SingleByteCodepage *single_byte_codepage(enum Encoding encoding) {\n")
+    out.write("  switch (encoding) {\n")
+    for name, _, _ in CODEPAGES:
+        for alias in ALIASES.get(name, []):
+            out.write(f"  case encoding_{alias}:\n")
+        out.write(f"  case encoding_{name}:\n    return &CODEPAGE_{name.upper()};\n")
+    out.write("  default:\n    return NULL;\n  }\n}\n\n#endif\n")
+
+
+if __name__ == "__main__":
+    main(sys.stdout)
@@ -0,0 +1,36 @@
+#ifndef HASH_HPP
+#define HASH_HPP
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FNV1A_OFFSET_BASIS 0xcbf29ce484222325
+
+// 64-bit FNV-1a
+static constexpr uint64_t fnv1a(const char *s, size_t len, uint64_t hash = FNV1A_OFFSET_BASIS) {
+  for (size_t i = 0; i < len; ++i) {
+    hash = (hash ^ (uint8_t)s[i]) * 0x100000001b3;
+  }
+  return hash;
+}
+
+// Fast hash for hash tables, a word at a time. Not stable across platforms; use fnv1a() for
+// hashes that are stored.
+static uint64_t hash_bytes(const uint8_t *s, size_t len) {
+  uint64_t hash = FNV1A_OFFSET_BASIS ^ len;
+  size_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    uint64_t word;
+    memcpy(&word, &s[i], 8);
+    hash = (hash ^ word) * 0x9e3779b97f4a7c15;
+    hash ^= hash >> 32;
+  }
+  if (i < len) {
+    uint64_t word = 0;
+    memcpy(&word, &s[i], len - i);
+    hash = (hash ^ word) * 0x9e3779b97f4a7c15;
+  }
+  return hash ^ (hash >> 29);
+}
+
+#endif
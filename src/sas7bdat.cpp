@@ -1,9 +1,23 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <exception>
+#include <mutex>
 #include <new>
 #include <stdexcept>
+#include <thread>
+#include <vector>
 
 #include "../include/sas7bdat.hpp"
+#include "arena.cpp"
+#include "arrow_builder.cpp"
+#include "arrow_ipc.cpp"
 #include "bitmap.hpp"
+#include "date_formats.hpp"
+#include "file_source.cpp"
+#include "hash.hpp"
 #include "sas_compression.cpp"
+#include "string_memo.cpp"
 
 // TODO(corr): amd pages
 
@@ -12,18 +26,11 @@
   "\x11\xcf\xbd\x92\x08\x00\x09\xc7\x31\x8c\x18\x1f\x10\x11"
 #define SAS_COMPRESSION_SIGNATURE_RLE "SASYZCRL"
 #define SAS_COMPRESSION_SIGNATURE_RDC "SASYZCR2"
-#define SAS_DATE_FORMATS                                                                           \
-  " DATE DAY DDMMYY DOWNAME JULDAY JULIAN MMDDYY MMYY MMYYC MMYYD MMYYP "                          \
-  "MMYYS MMYYN MONNAME MONTH MONYY QTR QTRR NENGO WEEKDATE WEEKDATX WEEKDAY "                      \
-  "WEEKV WORDDATE WORDDATX YEAR YYMM YYMMC YYMMD YYMMP YYMMS YYMMN YYMON "                         \
-  "YYMMDD YYQ YYQC YYQD YYQP YYQS YYQN YYQR YYQRC YYQRD YYQRP YYQRS YYQRN "                        \
-  "YYMMDDP YYMMDDC E8601DA YYMMDDN MMDDYYC MMDDYYS MMDDYYD YYMMDDS B8601DA "                       \
-  "DDMMYYN YYMMDDD DDMMYYB DDMMYYP MMDDYYP YYMMDDB MMDDYYN DDMMYYC DDMMYYD "                       \
-  "DDMMYYS MINGUO "
-#define SAS_DATETIME_FORMATS                                                                       \
-  " DATETIME DTWKDATX B8601DN B8601DT B8601DX B8601DZ B8601LX E8601DN "                            \
-  "E8601DT E8601DX E8601DZ E8601LX DATEAMPM DTDATE DTMONYY DTMONYY DTWKDATX "                      \
-  "DTYEAR TOD MDYAMPM "
+
+#define SECONDS_PER_DAY 86400
+
+// Rows decompressed at once for on_rows
+#define ROW_BATCH_BYTES (64 * 1024)
 
 #define PAGE_TYPE_MASK 0x0F00
 // Keep "page_comp_type" bits
@@ -52,11 +59,6 @@ enum SubheaderSignature {
   sh_signature_unknown2 = 0xfffffffe,
 };
 
-struct ParserFreeList {
-  void *ptr;
-  struct ParserFreeList *next;
-};
-
 struct Bytestring {
   uint8_t *data;
   size_t len;
@@ -67,13 +69,34 @@ struct ConstBytestring {
   size_t len;
 };
 
+struct PageIndexEntry {
+  size_t first_row;
+  size_t first_subheader; // Into page_index_subheaders, for meta pages
+  uint16_t type, block_count, subheader_count;
+};
+
+struct PageIndexSubheader {
+  uint32_t offset, len, signature;
+  bool truncated;
+};
+
+struct RowFilter {
+  enum RowFilterOp op;
+  size_t offset;
+  uint32_t len;
+  double value, value2;
+};
+
 struct Parser {
   struct FileInfo fileinfo;
   const struct ParserConfig *config;
-  struct ParserFreeList *freelist;
+  const struct Parser *parent;
+  struct ParserArena own_arena; // Used if config->arena is NULL
+  struct ParserArena *arena;
   struct ConstBytestring data;
   size_t data_min_offset;
   size_t header_count;
+  size_t first_data_page, first_data_subheader;
   size_t current_page;
   size_t current_subheader;
   size_t current_packed_row; // for mix and data pages
@@ -81,7 +104,9 @@ struct Parser {
   size_t row_length;
   size_t row_length8;
   struct bitmap *is_string_column_byte;
-  struct bitmap *is_space_byte;
+  struct bitmap *is_space_byte; // One per decompression batch row, is_space_byte_stride apart
+  size_t is_space_byte_stride;
+  size_t row_batch_size;
   // size_t mix_page_row_count;
   Bytestring *column_texts;
   size_t next_column_text_idx;
@@ -93,7 +118,21 @@ struct Parser {
   } seen_subheaders;
   bool row_compression_rle; // Otherwise RDC or no compression
   uint8_t *decompression_buf;
+  size_t selected_row_length;   // Bytes of a row up to the end of the last selected column
+  uint32_t *next_selected_byte; // row_length + 1 entries, NULL if all columns are selected
+  struct ColumnInfo *all_columns; // Before column selection
+  // Open addressing hash table of config->column_format_overrides, keyed by column name
+  const struct FormatOverride **format_overrides;
+  size_t format_overrides_mask;
+  size_t all_column_count;
+  struct RowFilter *row_filter;
+  size_t row_filter_len;
+  size_t current_batch_row; // Index of the row passed to on_row/on_rows in decompression_buf
   size_t rows_processed;
+  // Optional page index, header_count + 1 entries
+  const struct PageIndexEntry *page_index;
+  const struct PageIndexSubheader *page_index_subheaders;
+  uint64_t header_hash; // To detect stale parser states and page indexes
 };
 
 struct Page {
@@ -147,14 +186,16 @@ static void *parserzalloc(struct Parser *parser, size_t n) {
 #ifdef FUZZING_BUILD_MODE_UNSAFE_FOR_PRODUCTION
   assume(n <= 1 * 1024 * 1024, std::bad_alloc());
 #endif
-  void *ptr = calloc(n, 1);
-  assume(ptr != NULL, std::bad_alloc());
-  struct ParserFreeList *tail = parser->freelist;
-  parser->freelist = (struct ParserFreeList *)malloc(sizeof(struct ParserFreeList));
-  assume(parser->freelist != NULL, std::bad_alloc());
-  parser->freelist->ptr = ptr;
-  parser->freelist->next = tail;
-  return ptr;
+  return arena_zalloc(parser->arena, n);
+}
+
+static void init_arena(struct Parser *parser) {
+  if (parser->config->arena != NULL) {
+    parser->arena = parser->config->arena;
+  } else {
+    parser_arena_init(&parser->own_arena);
+    parser->arena = &parser->own_arena;
+  }
 }
 
 // Reading from SAS7BDAT bytes
@@ -220,6 +261,32 @@ static size_t subheader_contents_offset(const struct Parser *parser, size_t subh
   return page_offset + subheader_offset + wordsize(parser);
 }
 
+// Allocate buffers for decompressing a batch of rows (a single row if on_rows is not used)
+static void alloc_row_buffers(struct Parser *parser) {
+  parser->row_batch_size = 1;
+  if (parser->config->on_rows != NULL && parser->row_length < ROW_BATCH_BYTES) {
+    parser->row_batch_size = ROW_BATCH_BYTES / parser->row_length;
+  }
+  parser->decompression_buf = (uint8_t *)parserzalloc(
+      parser, parser->row_batch_size * parser->row_length + DECOMPRESSION_OUTPUT_SLACK);
+  size_t bitmap_size = next_multiple(parser->row_length, 8);
+  parser->is_space_byte_stride = next_multiple(bitmap_compute_size(bitmap_size), 8);
+  parser->is_space_byte = (struct bitmap *)parserzalloc(
+      parser, parser->row_batch_size * parser->is_space_byte_stride);
+  for (size_t i = 0; i < parser->row_batch_size; ++i) {
+    bitmap_init((struct bitmap *)((uint8_t *)parser->is_space_byte +
+                                  i * parser->is_space_byte_stride),
+                bitmap_size, false);
+  }
+}
+
+static void alloc_string_column_bitmap(struct Parser *parser) {
+  size_t bitmap_size = next_multiple(parser->row_length, 8);
+  parser->is_string_column_byte =
+      (struct bitmap *)parserzalloc(parser, bitmap_compute_size(bitmap_size));
+  bitmap_init(parser->is_string_column_byte, bitmap_size, false);
+}
+
 static void handle_row_size_subheader(struct Parser *parser, const struct Subheader *sh,
                                       size_t page_offset) {
   assume(!parser->seen_subheaders.row_size, sas7bdat_error("Unexpected row size subheader"));
@@ -229,13 +296,8 @@ static void handle_row_size_subheader(struct Parser *parser, const struct Subhea
   assume(parser->row_length <= 100 * 1024, sas7bdat_error("bad alloc"));
 #endif
   assume(parser->row_length > 0, sas7bdat_error("No rows"));
-  parser->decompression_buf = (uint8_t *)parserzalloc(parser, parser->row_length);
-  size_t bitmap_size = next_multiple(parser->row_length, 8);
-  parser->is_string_column_byte =
-      (struct bitmap *)parserzalloc(parser, bitmap_compute_size(bitmap_size));
-  parser->is_space_byte = (struct bitmap *)parserzalloc(parser, bitmap_compute_size(bitmap_size));
-  bitmap_init(parser->is_space_byte, bitmap_size, false);
-  bitmap_init(parser->is_string_column_byte, bitmap_size, false);
+  alloc_row_buffers(parser);
+  alloc_string_column_bitmap(parser);
   parser->fileinfo.row_count = read_size_t(parser, contents_offset + 5 * wordsize(parser));
   // parser->mix_page_row_count = read_size_t(parser, contents_offset + 14 * wordsize(parser));
   parser->seen_subheaders.row_size = true;
@@ -318,6 +380,67 @@ static void handle_column_attributes_subheader(struct Parser *parser, const stru
   }
 }
 
+static void build_format_override_table(struct Parser *parser) {
+  const struct FormatOverride *overrides = parser->config->column_format_overrides;
+  if (overrides == NULL) {
+    return;
+  }
+  size_t n_overrides = 0;
+  while (overrides[n_overrides].column_name != NULL) {
+    ++n_overrides;
+  }
+  size_t table_size = 1;
+  while (table_size < 2 * n_overrides) {
+    table_size *= 2;
+  }
+  parser->format_overrides = (const struct FormatOverride **)parserzalloc(
+      parser, sizeof(struct FormatOverride *) * table_size);
+  parser->format_overrides_mask = table_size - 1;
+  for (size_t i = 0; i < n_overrides; ++i) {
+    const char *name = overrides[i].column_name;
+    size_t slot = fnv1a(name, strlen(name)) & parser->format_overrides_mask;
+    while (parser->format_overrides[slot] != NULL &&
+           strcmp(parser->format_overrides[slot]->column_name, name)) {
+      slot = (slot + 1) & parser->format_overrides_mask;
+    }
+    // The first override of a column wins
+    if (parser->format_overrides[slot] == NULL) {
+      parser->format_overrides[slot] = &overrides[i];
+    }
+  }
+}
+
+static const struct FormatOverride *lookup_format_override(const struct Parser *parser,
+                                                           const char *name) {
+  size_t slot = fnv1a(name, strlen(name)) & parser->format_overrides_mask;
+  while (parser->format_overrides[slot] != NULL) {
+    if (!strcmp(parser->format_overrides[slot]->column_name, name)) {
+      return parser->format_overrides[slot];
+    }
+    slot = (slot + 1) & parser->format_overrides_mask;
+  }
+  return NULL;
+}
+
+// Override names are in the file's encoding or in UTF-8, see column_name_equals()
+static const struct FormatOverride *find_format_override(struct Parser *parser,
+                                                         const char *column_name) {
+  if (parser->format_overrides == NULL) {
+    return NULL;
+  }
+  const struct FormatOverride *format_override = lookup_format_override(parser, column_name);
+  const struct SingleByteCodepage *codepage = single_byte_codepage(parser->fileinfo.encoding);
+  size_t len = strlen(column_name);
+  if (format_override != NULL || codepage == NULL ||
+      ascii_prefix_len((const uint8_t *)column_name, len) == len) {
+    return format_override;
+  }
+  char *utf8_name = (char *)parserzalloc(parser, len * UTF8_MAX_EXPANSION + 1);
+  transcode_single_byte_to_utf8(codepage, (const uint8_t *)column_name, len,
+                                (uint8_t *)utf8_name);
+  return lookup_format_override(parser, utf8_name);
+}
+
 static void handle_column_format_and_label_subheader(struct Parser *parser,
                                                      const struct Subheader *sh,
                                                      size_t page_offset) {
@@ -326,27 +449,20 @@ static void handle_column_format_and_label_subheader(struct Parser *parser,
 
   struct ColumnInfo *colinfo = &parser->fileinfo.columns[parser->next_column_format_idx];
 
-  bool found_override = false;
-  const struct FormatOverride *column_format_overrides = parser->config->column_format_overrides;
-  if (column_format_overrides != NULL) {
-    while (column_format_overrides->column_name != NULL) {
-      if (strstr(column_format_overrides->column_name, colinfo->name)) {
-        if (column_format_overrides->format >= column_format_double) {
-          assume(colinfo->format == column_format_double,
-                 std::invalid_argument("Invalid column format override"));
-        }
-        colinfo->format = column_format_overrides->format;
-        if (column_format_overrides->len > 0) {
-          colinfo->len = column_format_overrides->len;
-        }
-        found_override = true;
-        break;
-      }
-      ++column_format_overrides;
+  const struct FormatOverride *format_override =
+      colinfo->name != NULL ? find_format_override(parser, colinfo->name) : NULL;
+  if (format_override != NULL) {
+    if (format_override->format >= column_format_double) {
+      assume(colinfo->format == column_format_double,
+             std::invalid_argument("Invalid column format override"));
+    }
+    colinfo->format = format_override->format;
+    if (format_override->len > 0) {
+      colinfo->len = format_override->len;
     }
   }
 
-  if (!found_override && colinfo->format == column_format_double) {
+  if (format_override == NULL && colinfo->format == column_format_double) {
     size_t contents_offset = subheader_contents_offset(parser, sh->offset, page_offset);
     size_t column_format_contents_offset = contents_offset + 22 + 2 * wordsize(parser);
     uint16_t column_format_index = read_uint16(parser, column_format_contents_offset);
@@ -359,16 +475,15 @@ static void handle_column_format_and_label_subheader(struct Parser *parser,
     }
     // Shortest date/datetime format string has length 3
     if (column_format_len >= 3) {
-      char column_format_buf[column_format_len + 3];
       assume(is_valid_range(column_format_offset, column_format_len,
                             parser->column_texts[column_format_index].len),
              sas7bdat_error("Unexpected column name offset or length"));
-      snprintf(column_format_buf, sizeof(column_format_buf) - 1, " %s ",
-               &parser->column_texts[column_format_index].data[column_format_offset]);
-      if (strstr(SAS_DATE_FORMATS, column_format_buf)) {
-        colinfo->format = column_format_date;
-      } else if (strstr(SAS_DATETIME_FORMATS, column_format_buf)) {
-        colinfo->format = column_format_datetime;
+      const char *column_format =
+          (const char *)&parser->column_texts[column_format_index].data[column_format_offset];
+      enum ColumnFormat date_format =
+          lookup_date_format(column_format, strnlen(column_format, column_format_len));
+      if (date_format != column_format_none) {
+        colinfo->format = date_format;
       }
     }
   }
@@ -376,7 +491,7 @@ static void handle_column_format_and_label_subheader(struct Parser *parser,
   ++parser->next_column_format_idx;
 }
 
-static void handle_unknown(struct Parser *, const struct Subheader *sh, size_t) {
+static void handle_unknown(struct Parser *, const struct Subheader *, size_t) {
 }
 
 static subheader_handler *get_subheader_handler(uint32_t signature) {
@@ -451,56 +566,190 @@ static size_t page_packed_row_count(const struct Page *page) {
   return page->block_count - page->subheader_count;
 }
 
-static int _cmp_columninfo_offset(const void *a, const void *b) {
-  const struct ColumnInfo *ca = (struct ColumnInfo *)a, *cb = (struct ColumnInfo *)b;
-  return ca->offset > cb->offset ? 1 : (ca->offset == cb->offset ? 0 : -1);
+static struct bitmap *batch_row_is_space_byte(const struct Parser *parser, size_t batch_row_idx) {
+  return (struct bitmap *)((uint8_t *)parser->is_space_byte +
+                           batch_row_idx * parser->is_space_byte_stride);
+}
+
+static bool row_matches_filter(const struct Parser *parser, const uint8_t *row) {
+  if (parser->row_filter_len == 0) {
+    return true;
+  }
+  // Stack of boolean results, top is the lowest bit
+  uint64_t stack = 0;
+  for (size_t i = 0; i < parser->row_filter_len; ++i) {
+    const struct RowFilter *term = &parser->row_filter[i];
+    if (term->op == row_filter_and || term->op == row_filter_or) {
+      bool a = stack & 1, b = (stack >> 1) & 1;
+      stack = (stack >> 2) << 1 | (term->op == row_filter_and ? a && b : a || b);
+      continue;
+    }
+    double x;
+    decimal2double(&row[term->offset], term->len, parser->fileinfo.is_little_endian, &x);
+    bool result;
+    switch (term->op) {
+    case row_filter_lt:
+      result = x < term->value;
+      break;
+    case row_filter_le:
+      result = x <= term->value;
+      break;
+    case row_filter_gt:
+      result = x > term->value;
+      break;
+    case row_filter_ge:
+      result = x >= term->value;
+      break;
+    case row_filter_eq:
+      result = x == term->value;
+      break;
+    case row_filter_ne:
+      result = !std::isnan(x) && x != term->value;
+      break;
+    case row_filter_between:
+      result = x >= term->value && x <= term->value2;
+      break;
+    case row_filter_is_null:
+      result = std::isnan(x);
+      break;
+    case row_filter_not_null:
+      result = !std::isnan(x);
+      break;
+    default:
+      __builtin_unreachable();
+    }
+    stack = stack << 1 | result;
+  }
+  return stack & 1;
+}
+
+// Pass the rows that match the row filter to on_rows() (in runs of consecutive matching rows) or
+// to on_row(). Return true if the consumer asked parse() to return; *n_consumed is set to the
+// number of rows that were consumed or skipped.
+static bool deliver_rows(struct Parser *parser, const uint8_t *rows, size_t n_rows,
+                         bool have_fast_space_offsets, size_t *n_consumed) {
+  const struct ParserConfig *config = parser->config;
+  size_t row_length = parser->row_length;
+  bool yield = false;
+  size_t i = 0;
+  while (!yield && i < n_rows) {
+    if (!row_matches_filter(parser, &rows[i * row_length])) {
+      ++i;
+      ++parser->rows_processed;
+      continue;
+    }
+    parser->current_batch_row = i;
+    if (config->on_rows != NULL) {
+      size_t n_run = 1;
+      while (i + n_run < n_rows && row_matches_filter(parser, &rows[(i + n_run) * row_length])) {
+        ++n_run;
+      }
+      size_t n_run_consumed = config->on_rows(config->userdata, &rows[i * row_length], n_run,
+                                              row_length, have_fast_space_offsets);
+      assume(n_run_consumed <= n_run, std::invalid_argument("on_rows consumed too many rows"));
+      i += n_run_consumed;
+      parser->rows_processed += n_run_consumed;
+      yield = n_run_consumed < n_run;
+      if (!yield && i < n_rows) {
+        // The run ended at a row that is already known not to match
+        ++i;
+        ++parser->rows_processed;
+      }
+    } else {
+      yield = config->on_row(config->userdata, &rows[i * row_length], have_fast_space_offsets);
+      ++i;
+      ++parser->rows_processed;
+    }
+  }
+  *n_consumed = i;
+  return yield;
+}
+
+static size_t page_index_of(const struct Parser *parser, const struct Page *page) {
+  return (page->offset - parser->header_len) / parser->page_len;
+}
+
+// parse_subheader(), or a lookup in the page index if there is one
+static bool get_subheader(const struct Parser *parser, const struct Page *page,
+                          size_t subheader_idx, struct Subheader *sh) {
+  if (parser->page_index == NULL) {
+    return parse_subheader(parser, page->offset, subheader_idx, sh);
+  }
+  const struct PageIndexEntry *entry = &parser->page_index[page_index_of(parser, page)];
+  assert2(subheader_idx < entry->subheader_count);
+  const struct PageIndexSubheader *indexed =
+      &parser->page_index_subheaders[entry->first_subheader + subheader_idx];
+  sh->offset = indexed->offset;
+  sh->len = indexed->len;
+  sh->signature = indexed->signature;
+  return indexed->truncated;
 }
 
 static bool parse_meta_page_data(struct Parser *parser, const struct Page *page) {
   // TODO(corr) parser->rows_processed < row_count
-  // TODO(corr) wrong on some files (not truncated?)
-  assume(parser->current_subheader < page->subheader_count - 1,
+  assume(parser->current_subheader < page->subheader_count,
          sas7bdat_error("Unexpected subheader"));
 
   // TODO(corr) if we abort here due to rows_processed >= row_count, will we
   // come back here and fall into an infinite loop or are exiting somwhere
   // else?
   bool yield = false;
-  size_t i;
-  for (i = parser->current_subheader; !yield && i < page->subheader_count; ++i) {
-    // TODO(corr) previous version first parsed all subheaders, why?
-    struct Subheader sh;
-    if (parse_subheader(parser, page->offset, i, &sh)) {
-      continue;
-    }
-    assert2(sh.signature == sh_signature_none);
-    // Data subheaders don't have a signature, thus start wordsize() earlier
-    // than other subheaders
-    size_t contents_offset =
-        subheader_contents_offset(parser, sh.offset, page->offset) - wordsize(parser);
-    check_parser_data_read(parser, contents_offset, sh.len);
-    const uint8_t *row_source = &parser->data.data[contents_offset];
-    if (sh.len < parser->row_length) {
-      sas_decompressor *decompressor;
-      if (parser->row_compression_rle) {
-        decompressor = rle;
-        bitmap_set(parser->is_space_byte, 0, bitmap_data_size(parser->is_space_byte), false);
-      } else {
-        decompressor = rdc;
+  size_t i = parser->current_subheader;
+  while (!yield && i < page->subheader_count) {
+    // Collect a run of rows from consecutive subheaders. Compressed rows are decompressed into
+    // consecutive slots of decompression_buf; uncompressed rows are passed one by one.
+    const uint8_t *rows = NULL;
+    size_t n_rows = 0;
+    bool have_fast_space_offsets = false;
+    while (n_rows < parser->row_batch_size && i + n_rows < page->subheader_count) {
+      // TODO(corr) previous version first parsed all subheaders, why?
+      struct Subheader sh;
+      if (get_subheader(parser, page, i + n_rows, &sh)) {
+        if (n_rows > 0) {
+          break;
+        }
+        ++i;
+        continue;
+      }
+      assert2(sh.signature == sh_signature_none);
+      // Data subheaders don't have a signature, thus start wordsize() earlier
+      // than other subheaders
+      size_t contents_offset =
+          subheader_contents_offset(parser, sh.offset, page->offset) - wordsize(parser);
+      check_parser_data_read(parser, contents_offset, sh.len);
+      const uint8_t *row_source = &parser->data.data[contents_offset];
+      if (sh.len >= parser->row_length) {
+        if (n_rows == 0) {
+          rows = row_source;
+          n_rows = 1;
+        }
+        break;
       }
+      struct bitmap *is_space_byte = batch_row_is_space_byte(parser, n_rows);
+      bitmap_set(is_space_byte, 0, bitmap_data_size(is_space_byte), false);
+      uint8_t *row = &parser->decompression_buf[n_rows * parser->row_length];
       size_t len_decompressed =
-          decompressor(row_source, sh.len, parser->decompression_buf, parser->row_length,
-                       parser->is_string_column_byte, parser->is_space_byte);
-      assume(len_decompressed == parser->row_length,
+          parser->row_compression_rle
+              ? rle(row_source, sh.len, row, parser->row_length, parser->selected_row_length,
+                    parser->next_selected_byte, parser->is_string_column_byte, is_space_byte)
+              : rdc(row_source, sh.len, row, parser->row_length, parser->selected_row_length,
+                    parser->is_string_column_byte, is_space_byte);
+      // Decompression stops at the end of the last selected column (the end of the row if all
+      // columns are selected), and the bytes after it are never read.
+      assume(len_decompressed >= parser->selected_row_length,
              sas7bdat_error("Too few decompressed bytes in row"));
-      yield = parser->config->on_row(parser->config->userdata, parser->decompression_buf,
-                                     decompressor == rle);
-    } else {
-      yield = parser->config->on_row(parser->config->userdata, row_source, false);
+      rows = parser->decompression_buf;
+      have_fast_space_offsets = true;
+      ++n_rows;
+    }
+    if (n_rows == 0) {
+      break;
     }
+    size_t n_consumed;
+    yield = deliver_rows(parser, rows, n_rows, have_fast_space_offsets, &n_consumed);
+    i += n_consumed;
   }
-  assert2(i > 0);
-  if (i >= page->subheader_count - 1 /* truncated */) {
+  if (i >= page->subheader_count) {
     ++parser->current_page;
     parser->current_subheader = 0;
   } else {
@@ -519,19 +768,20 @@ static bool parse_mix_or_data_page_data(struct Parser *parser, const struct Page
     data_start += page->subheader_count * if32bit(parser, 12, 24);
     data_start += data_start % 8;
   }
-  bool yield = false;
-  size_t i;
-  assert2(page_packed_row_count(page) > 0);
-  for (i = parser->current_packed_row; !yield && i < page_packed_row_count(page); ++i) {
-    yield = parser->config->on_row(parser->config->userdata,
-                                   &parser->data.data[data_start + i * parser->row_length], false);
-  }
-  assert2(i > 0);
-  if (i >= page_packed_row_count(page)) {
+  size_t n_rows = page_packed_row_count(page);
+  assert2(n_rows > 0);
+  size_t rows_start = data_start + parser->current_packed_row * parser->row_length;
+  n_rows -= parser->current_packed_row;
+  assume(n_rows <= SIZE_MAX / parser->row_length, std::domain_error("Too many rows in page"));
+  check_parser_data_read(parser, rows_start, n_rows * parser->row_length);
+  size_t n_consumed;
+  bool yield =
+      deliver_rows(parser, &parser->data.data[rows_start], n_rows, false, &n_consumed);
+  if (n_consumed >= n_rows) {
     ++parser->current_page;
     parser->current_packed_row = 0;
   } else {
-    parser->current_packed_row = i;
+    parser->current_packed_row += n_consumed;
   }
   return yield;
 }
@@ -613,24 +863,312 @@ static size_t process_metadata_subheaders(struct Parser *parser, const struct Pa
   return i;
 }
 
-// Parser object lifecycle
+// read_current_page(), or a lookup in the page index if there is one
+static struct Page get_current_page(const struct Parser *parser) {
+  if (parser->page_index == NULL) {
+    return read_current_page(parser);
+  }
+  const struct PageIndexEntry *entry = &parser->page_index[parser->current_page];
+  return {
+      .offset = page_offset(parser, parser->current_page),
+      .type = entry->type,
+      .block_count = entry->block_count,
+      .subheader_count = entry->subheader_count,
+  };
+}
+
+static bool parse_current_page(struct Parser *parser) {
+  ensure_current_page(parser);
+  struct Page page = get_current_page(parser);
+  if (page_may_have_data_subheaders(page.type)) {
+    return parse_meta_page_data(parser, &page);
+  } else if (page_may_have_packed_data(page.type)) {
+    return parse_mix_or_data_page_data(parser, &page);
+  } else {
+    ++parser->current_page;
+    return false;
+  }
+}
+
+// Random access
+
+// Subheader index at which parse() starts reading rows from a page.
+static size_t page_first_row_subheader(const struct Parser *parser, size_t page_idx) {
+  return page_idx == parser->first_data_page ? parser->first_data_subheader : 0;
+}
+
+// Number of rows in a page, starting at subheader/packed row 'start'.
+// Only reads the page header and subheader pointers, not the rows themselves.
+static size_t page_row_count(const struct Parser *parser, const struct Page *page, size_t start) {
+  if (page_may_have_packed_data(page->type)) {
+    return start < page_packed_row_count(page) ? page_packed_row_count(page) - start : 0;
+  } else if (page_may_have_data_subheaders(page->type)) {
+    size_t n = 0;
+    for (size_t i = start; i < page->subheader_count; ++i) {
+      struct Subheader sh;
+      n += !get_subheader(parser, page, i, &sh);
+    }
+    return n;
+  } else {
+    return 0;
+  }
+}
+
+// Index of the n-th non-truncated subheader of a meta page, starting at 'start'.
+static size_t meta_page_nth_row_subheader(const struct Parser *parser, const struct Page *page,
+                                          size_t start, size_t n) {
+  for (size_t i = start; i < page->subheader_count; ++i) {
+    struct Subheader sh;
+    if (!get_subheader(parser, page, i, &sh) && n-- == 0) {
+      return i;
+    }
+  }
+  assert2(false);
+  return page->subheader_count;
+}
+
+// Whether 'column_name', in the file's encoding, is 'name', which is in the file's encoding or,
+// if that is a single-byte encoding, in UTF-8.
+static bool column_name_equals(const struct Parser *parser, const char *column_name,
+                               const char *name) {
+  if (!strcmp(column_name, name)) {
+    return true;
+  }
+  const struct SingleByteCodepage *codepage = single_byte_codepage(parser->fileinfo.encoding);
+  if (codepage == NULL) {
+    return false;
+  }
+  const uint8_t *s = (const uint8_t *)column_name, *t = (const uint8_t *)name;
+  for (; *s != 0; ++s) {
+    uint8_t utf8[UTF8_MAX_EXPANSION];
+    size_t n = 1;
+    if (*s & 0x80) {
+      n = utf8_encode(codepage->high[*s - 0x80], utf8);
+    } else {
+      utf8[0] = *s;
+    }
+    // Stops at the end of 'name' since none of the bytes in 'utf8' is 0
+    for (size_t k = 0; k < n; ++k, ++t) {
+      if (*t != utf8[k]) {
+        return false;
+      }
+    }
+  }
+  return *t == 0;
+}
+
+static const struct ColumnInfo *find_column(const struct Parser *parser, const char *name) {
+  for (size_t i = 0; i < parser->fileinfo.column_count; ++i) {
+    if (column_name_equals(parser, parser->fileinfo.columns[i].name, name)) {
+      return &parser->fileinfo.columns[i];
+    }
+  }
+  return NULL;
+}
+
+static void resolve_row_filter(struct Parser *parser) {
+  const struct ParserConfig *config = parser->config;
+  if (config->row_filter_len == 0) {
+    return;
+  }
+  assume(config->row_filter != NULL, std::invalid_argument("row_filter must not be NULL"));
+  parser->row_filter_len = config->row_filter_len;
+  parser->row_filter =
+      (struct RowFilter *)parserzalloc(parser, sizeof(struct RowFilter) * parser->row_filter_len);
+  size_t depth = 0;
+  for (size_t i = 0; i < parser->row_filter_len; ++i) {
+    const struct RowFilterTerm *term = &config->row_filter[i];
+    struct RowFilter *resolved = &parser->row_filter[i];
+    resolved->op = term->op;
+    if (term->op == row_filter_and || term->op == row_filter_or) {
+      assume(depth >= 2, std::invalid_argument("Invalid row filter"));
+      --depth;
+      continue;
+    }
+    assume(term->op >= row_filter_lt && term->op <= row_filter_not_null,
+           std::invalid_argument("Invalid row filter operator"));
+    assume(term->column_name != NULL, std::invalid_argument("Missing row filter column name"));
+    const struct ColumnInfo *colinfo = find_column(parser, term->column_name);
+    assume(colinfo != NULL, std::invalid_argument("Unknown column in row_filter"));
+    assume(colinfo->format >= column_format_double && colinfo->len >= 3 && colinfo->len <= 8 &&
+               is_valid_range(colinfo->offset, colinfo->len, parser->row_length),
+           std::invalid_argument("Row filter column must be numeric"));
+    resolved->offset = colinfo->offset;
+    resolved->len = colinfo->len;
+    resolved->value = term->value;
+    resolved->value2 = term->value2;
+    if (term->datetime_values) {
+      assume(column_format_is_date_time(colinfo->format),
+             std::invalid_argument("Row filter date values need a date or datetime column"));
+      if (colinfo->format == column_format_date) {
+        resolved->value /= SECONDS_PER_DAY;
+        resolved->value2 /= SECONDS_PER_DAY;
+      }
+    }
+    ++depth;
+    assume(depth <= 64, std::invalid_argument("Row filter too deeply nested"));
+  }
+  assume(depth == 1, std::invalid_argument("Invalid row filter"));
+}
+
+// Drop columns that are not in config->selected_columns and set up the decompressors to skip
+// bytes that are not covered by any of the remaining columns.
+static void select_columns(struct Parser *parser) {
+  parser->all_columns = parser->fileinfo.columns;
+  parser->all_column_count = parser->fileinfo.column_count;
+  parser->selected_row_length = parser->row_length;
+  const char *const *selected_columns = parser->config->selected_columns;
+  if (selected_columns == NULL) {
+    return;
+  }
+  struct FileInfo *fileinfo = &parser->fileinfo;
+  bool *is_selected = (bool *)parserzalloc(parser, fileinfo->column_count);
+  for (; *selected_columns != NULL; ++selected_columns) {
+    const struct ColumnInfo *colinfo = find_column(parser, *selected_columns);
+    assume(colinfo != NULL, std::invalid_argument("Unknown column in selected_columns"));
+    is_selected[colinfo - fileinfo->columns] = true;
+  }
+  size_t n_selected = 0;
+  for (size_t i = 0; i < fileinfo->column_count; ++i) {
+    n_selected += is_selected[i];
+  }
+  assume(n_selected > 0, std::invalid_argument("No columns selected"));
+  fileinfo->columns =
+      (struct ColumnInfo *)parserzalloc(parser, sizeof(struct ColumnInfo) * n_selected);
+  fileinfo->column_count = 0;
+  for (size_t i = 0; i < parser->all_column_count; ++i) {
+    if (is_selected[i]) {
+      fileinfo->columns[fileinfo->column_count++] = parser->all_columns[i];
+    }
+  }
+
+  assume(parser->row_length < UINT32_MAX, sas7bdat_error("Row length too large"));
+  parser->next_selected_byte =
+      (uint32_t *)parserzalloc(parser, sizeof(uint32_t) * (parser->row_length + 1));
+  for (size_t i = 0; i <= parser->row_length; ++i) {
+    parser->next_selected_byte[i] = parser->row_length;
+  }
+  parser->selected_row_length = 0;
+  for (size_t i = 0; i < fileinfo->column_count; ++i) {
+    const struct ColumnInfo *colinfo = &fileinfo->columns[i];
+    size_t end = std::min(colinfo->offset + colinfo->len, parser->row_length);
+    for (size_t pos = colinfo->offset; pos < end; ++pos) {
+      parser->next_selected_byte[pos] = pos;
+    }
+    parser->selected_row_length = std::max(parser->selected_row_length, end);
+  }
+  // Filtered columns must be decompressed, too
+  for (size_t i = 0; i < parser->row_filter_len; ++i) {
+    const struct RowFilter *term = &parser->row_filter[i];
+    if (term->op == row_filter_and || term->op == row_filter_or) {
+      continue;
+    }
+    for (size_t pos = term->offset; pos < term->offset + term->len; ++pos) {
+      parser->next_selected_byte[pos] = pos;
+    }
+    parser->selected_row_length = std::max(parser->selected_row_length, term->offset + term->len);
+  }
+  for (size_t i = parser->row_length; i-- > 0;) {
+    parser->next_selected_byte[i] =
+        std::min(parser->next_selected_byte[i], parser->next_selected_byte[i + 1]);
+  }
+}
+
+// Order the (selected) columns by offset and merge runs of adjacent columns with the same format
+// and length into spans, so that consumers can process a span in one go.
+static void build_column_plan(struct Parser *parser) {
+  struct FileInfo *fileinfo = &parser->fileinfo;
+  size_t *column_order = (size_t *)parserzalloc(parser, sizeof(size_t) * fileinfo->column_count);
+  for (size_t i = 0; i < fileinfo->column_count; ++i) {
+    column_order[i] = i;
+  }
+  std::stable_sort(column_order, column_order + fileinfo->column_count, [&](size_t a, size_t b) {
+    return fileinfo->columns[a].offset < fileinfo->columns[b].offset;
+  });
+
+  struct ColumnSpan *spans =
+      (struct ColumnSpan *)parserzalloc(parser, sizeof(struct ColumnSpan) * fileinfo->column_count);
+  size_t span_count = 0;
+  for (size_t i = 0; i < fileinfo->column_count; ++i) {
+    const struct ColumnInfo *colinfo = &fileinfo->columns[column_order[i]];
+    struct ColumnSpan *span = span_count > 0 ? &spans[span_count - 1] : NULL;
+    if (span != NULL && span->format == colinfo->format && span->column_len == colinfo->len &&
+        span->offset + span->n_columns * span->column_len == colinfo->offset) {
+      ++span->n_columns;
+    } else {
+      spans[span_count++] = {.first_column = i,
+                             .n_columns = 1,
+                             .offset = colinfo->offset,
+                             .column_len = colinfo->len,
+                             .format = colinfo->format};
+    }
+  }
+  fileinfo->column_order = column_order;
+  fileinfo->spans = spans;
+  fileinfo->span_count = span_count;
+}
 
 size_t parser_struct_size() {
   return sizeof(struct Parser);
 }
 
-void parser_init(struct Parser *parser, const struct ParserConfig *config) {
-  assume(parser != NULL, std::invalid_argument("parser must not be NULL"));
+// FNV-1a of the start of the file header, which contains the file's modification time and page
+// count
+#define HEADER_HASH_LEN 1000
+
+static uint64_t hash_header(const struct Parser *parser) {
+  size_t len = std::min<size_t>(parser->data.len, HEADER_HASH_LEN);
+  return fnv1a((const char *)parser->data.data, len);
+}
+
+static void check_config(const struct ParserConfig *config) {
   assume(config->on_pagefault != NULL, std::invalid_argument("on_pagefault must not be NULL"));
   assume(config->on_metadata != NULL, std::invalid_argument("on_metadata must not be NULL"));
-  assume(config->on_row != NULL, std::invalid_argument("on_row must not be NULL"));
+  assume(config->metadata_only || config->on_row != NULL || config->on_rows != NULL,
+         std::invalid_argument("on_row or on_rows must not be NULL"));
+}
+
+static size_t compute_header_count(const struct Parser *parser) {
+  // header_count = actual headers. == page_count for valid files.
+  if (parser->config->filesize_override) {
+    assume(parser->config->filesize_override >= parser->header_len,
+           std::invalid_argument("filesize_override must be >= header_len"));
+    return (parser->config->filesize_override - parser->header_len) / parser->page_len;
+  } else {
+    return parser->fileinfo.page_count;
+  }
+}
+
+// Apply the row filter and column selection, build the column access plan, then pass the metadata
+// to on_metadata().
+static void finish_init(struct Parser *parser) {
+  resolve_row_filter(parser);
+  select_columns(parser);
+  build_column_plan(parser);
+
+  for (size_t i = 0; i < parser->fileinfo.column_count; ++i) {
+    bool is_string_column = parser->fileinfo.columns[i].format == column_format_string;
+    bitmap_set(parser->is_string_column_byte, parser->fileinfo.columns[i].offset,
+               parser->fileinfo.columns[i].offset + parser->fileinfo.columns[i].len,
+               is_string_column);
+  }
+
+  parser->config->on_metadata(parser->config->userdata, &parser->fileinfo);
+}
+
+void parser_init(struct Parser *parser, const struct ParserConfig *config) {
+  assume(parser != NULL, std::invalid_argument("parser must not be NULL"));
+  check_config(config);
 
   memset(parser, 0, parser_struct_size());
   parser->config = config;
+  init_arena(parser);
+  build_format_override_table(parser);
 
   handle_pagefault(parser, 0, 1000);
   assume(!strcmp((char *)parser->data.data, (char *)SAS_MAGIC),
          sas7bdat_error("Invalid SAS magic, not a SAS7BDAT file?"));
+  parser->header_hash = hash_header(parser);
 
   parser->fileinfo.is_32_bit = read_uint8(parser, 32) != '3';
   parser->fileinfo.is_little_endian = read_uint8(parser, 37);
@@ -642,24 +1180,19 @@ void parser_init(struct Parser *parser, const struct ParserConfig *config) {
   parser->fileinfo.page_count = read_size_t(parser, 204 + align);
   assume(parser->page_len > 0 && parser->fileinfo.page_count > 0 && parser->header_len > 0,
          sas7bdat_error("Invalid page length, page count, or header length"));
-  // header_count = actual headers. == page_count for valid files.
-  if (config->filesize_override) {
-    assume(config->filesize_override >= parser->header_len,
-           std::invalid_argument("filesize_override must be >= header_len"));
-    parser->header_count = (config->filesize_override - parser->header_len) / parser->page_len;
-  } else {
-    parser->header_count = parser->fileinfo.page_count;
-  }
+  parser->header_count = compute_header_count(parser);
 
   for (; parser->current_page < parser->header_count; ++parser->current_page) {
     ensure_current_page(parser);
     struct Page page = read_current_page(parser);
+    parser->first_data_page = parser->current_page;
     if (page_is_meta_type(page.type)) {
       assume(page.block_count == page.subheader_count, "Invalid subheader count in page");
       size_t n_subheaders_processed = process_metadata_subheaders(parser, &page);
       if (n_subheaders_processed < page.subheader_count) {
         // Set up page + subheader pointers for call to parse()
         parser->current_subheader = n_subheaders_processed;
+        parser->first_data_subheader = n_subheaders_processed;
         goto done;
       }
     } else if (page_may_have_packed_data(page.type)) {
@@ -682,23 +1215,11 @@ done:
              parser->next_column_format_idx == parser->fileinfo.column_count,
          sas7bdat_error("Incomplete column metadata"));
 
-#if 0
-  // Sort columns by offset
-  // TODO(perf) Sometimes decreases performance but never increases it.
-  qsort(parser->fileinfo.columns, parser->fileinfo.column_count, sizeof(*parser->fileinfo.columns), _cmp_columninfo_offset);
-#endif
-
-  for (size_t i = 0; i < parser->fileinfo.column_count; ++i) {
-    bool is_string_column = parser->fileinfo.columns[i].format == column_format_string;
-    bitmap_set(parser->is_string_column_byte, parser->fileinfo.columns[i].offset,
-               parser->fileinfo.columns[i].offset + parser->fileinfo.columns[i].len,
-               is_string_column);
-  }
-
-  parser->config->on_metadata(parser->config->userdata, &parser->fileinfo);
+  finish_init(parser);
 }
 
 bool parse(struct Parser *parser) {
+  assume(!parser->config->metadata_only, std::invalid_argument("Parser is metadata-only"));
   size_t stop =
       parser->config->max_pages > 0 ? parser->current_page + parser->config->max_pages : SIZE_MAX;
   if (stop > parser->header_count) {
@@ -706,36 +1227,590 @@ bool parse(struct Parser *parser) {
   }
   bool yield = false;
   for (; !yield && parser->current_page < stop;) {
+    yield = parse_current_page(parser);
+  }
+  // TODO(corr) what to return if actual pages read < expected pages read?
+  // (truncated buffer)
+  return yield; // have more data?
+}
+
+bool parser_seek_page(struct Parser *parser, size_t page_idx) {
+  if (page_idx < parser->first_data_page) {
+    page_idx = parser->first_data_page;
+  } else if (page_idx > parser->header_count) {
+    page_idx = parser->header_count;
+  }
+  parser->current_page = page_idx;
+  parser->current_subheader = page_first_row_subheader(parser, page_idx);
+  parser->current_packed_row = 0;
+  if (parser->page_index != NULL) {
+    parser->rows_processed = parser->page_index[page_idx].first_row;
+  }
+  return parser->current_page < parser->header_count;
+}
+
+bool parser_seek_row(struct Parser *parser, size_t row_idx) {
+  size_t page_idx = 0, page_row_idx = row_idx;
+  if (parser->page_index != NULL) {
+    const struct PageIndexEntry *index = parser->page_index;
+    page_idx = std::upper_bound(index, index + parser->header_count + 1, row_idx,
+                                [](size_t row_idx, const struct PageIndexEntry &entry) {
+                                  return row_idx < entry.first_row;
+                                }) -
+               index - 1;
+    page_row_idx = row_idx - index[page_idx].first_row;
+  }
+  for (parser_seek_page(parser, page_idx); parser->current_page < parser->header_count;
+       ++parser->current_page) {
+    if (parser->page_index == NULL) {
+      ensure_current_page(parser);
+    }
+    struct Page page = get_current_page(parser);
+    size_t start = page_first_row_subheader(parser, parser->current_page);
+    size_t n_rows = page_row_count(parser, &page, start);
+    if (page_row_idx < n_rows) {
+      if (page_may_have_packed_data(page.type)) {
+        parser->current_subheader = 0;
+        parser->current_packed_row = start + page_row_idx;
+      } else {
+        parser->current_subheader =
+            meta_page_nth_row_subheader(parser, &page, start, page_row_idx);
+        parser->current_packed_row = 0;
+      }
+      parser->rows_processed = row_idx;
+      return true;
+    }
+    page_row_idx -= n_rows;
+  }
+  return false;
+}
+
+size_t parser_row_index(const struct Parser *parser) {
+  return parser->rows_processed;
+}
+
+void parser_build_page_index(struct Parser *parser) {
+  if (parser->page_index != NULL) {
+    return;
+  }
+  struct PageIndexEntry *index = (struct PageIndexEntry *)parserzalloc(
+      parser, (parser->header_count + 1) * sizeof(struct PageIndexEntry));
+  std::vector<struct PageIndexSubheader> subheaders;
+  size_t current_page = parser->current_page, current_subheader = parser->current_subheader,
+         current_packed_row = parser->current_packed_row;
+  size_t n_rows = 0;
+  for (parser->current_page = parser->first_data_page;
+       parser->current_page < parser->header_count; ++parser->current_page) {
     ensure_current_page(parser);
     struct Page page = read_current_page(parser);
+    struct PageIndexEntry *entry = &index[parser->current_page];
+    *entry = {.first_row = n_rows,
+              .first_subheader = subheaders.size(),
+              .type = page.type,
+              .block_count = page.block_count,
+              .subheader_count = page.subheader_count};
     if (page_may_have_data_subheaders(page.type)) {
-      yield = parse_meta_page_data(parser, &page);
-    } else if (page_may_have_packed_data(page.type)) {
-      yield = parse_mix_or_data_page_data(parser, &page);
-    } else {
-      ++parser->current_page;
-      continue;
+      for (size_t i = 0; i < page.subheader_count; ++i) {
+        struct Subheader sh;
+        bool truncated = parse_subheader(parser, page.offset, i, &sh);
+        assume(truncated || (sh.offset <= UINT32_MAX && sh.len <= UINT32_MAX),
+               sas7bdat_error("Invalid subheader pointer"));
+        subheaders.push_back({.offset = truncated ? 0 : (uint32_t)sh.offset,
+                              .len = truncated ? 0 : (uint32_t)sh.len,
+                              .signature = truncated ? 0 : sh.signature,
+                              .truncated = truncated});
+      }
     }
+    n_rows += page_row_count(parser, &page, page_first_row_subheader(parser, parser->current_page));
   }
-  // TODO(corr) what to return if actual pages read < expected pages read?
-  // (truncated buffer)
-  return yield; // have more data?
+  index[parser->header_count].first_row = n_rows;
+  index[parser->header_count].first_subheader = subheaders.size();
+  struct PageIndexSubheader *index_subheaders = (struct PageIndexSubheader *)parserzalloc(
+      parser, (subheaders.size() + 1) * sizeof(struct PageIndexSubheader));
+  std::copy(subheaders.begin(), subheaders.end(), index_subheaders);
+  parser->current_page = current_page;
+  parser->current_subheader = current_subheader;
+  parser->current_packed_row = current_packed_row;
+  parser->page_index = index;
+  parser->page_index_subheaders = index_subheaders;
 }
 
 void parser_deinit(struct Parser *parser) {
-  for (struct ParserFreeList *item = parser->freelist; item != NULL;) {
-    free(item->ptr);
-    struct ParserFreeList *next = item->next;
-    free(item);
-    item = next;
+  if (parser->arena == &parser->own_arena) {
+    parser_arena_deinit(&parser->own_arena);
+  }
+}
+
+// Parser state serialization
+//
+// All integers are little-endian. Layout:
+//   magic, is_32_bit u8, is_little_endian u8, encoding u16, row_compression_rle u8,
+//   header_hash u64, header_len u64, page_len u64, page_count u64, row_count u64, row_length u64,
+//   first_data_page u64, first_data_subheader u64, column_count u64,
+//   column_count * (offset u32, len u32, format u8, name_len u16, name)
+
+#define PARSER_STATE_MAGIC "SAS7BDATSTATE001"
+
+struct StateWriter {
+  uint8_t *buf;
+  size_t len, pos;
+};
+
+struct StateReader {
+  const uint8_t *buf;
+  size_t len, pos;
+};
+
+static void state_write(struct StateWriter *w, const void *src, size_t n) {
+  if (n > 0 && w->pos <= w->len && n <= w->len - w->pos) {
+    memcpy(&w->buf[w->pos], src, n);
+  }
+  w->pos += n;
+}
+
+static void state_write_uint(struct StateWriter *w, uint64_t value, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    uint8_t byte = value >> (8 * i);
+    state_write(w, &byte, 1);
+  }
+}
+
+static void state_read(struct StateReader *r, void *dst, size_t n) {
+  assume(r->pos <= r->len && n <= r->len - r->pos,
+         std::invalid_argument("Truncated parser state or page index"));
+  memcpy(dst, &r->buf[r->pos], n);
+  r->pos += n;
+}
+
+static uint64_t state_read_uint(struct StateReader *r, size_t n) {
+  uint8_t bytes[8];
+  state_read(r, bytes, n);
+  uint64_t value = 0;
+  for (size_t i = 0; i < n; ++i) {
+    value |= (uint64_t)bytes[i] << (8 * i);
+  }
+  return value;
+}
+
+size_t parser_serialize_state(const struct Parser *parser, uint8_t *buf, size_t buf_len) {
+  struct StateWriter w = {.buf = buf, .len = buf_len, .pos = 0};
+  state_write(&w, PARSER_STATE_MAGIC, strlen(PARSER_STATE_MAGIC));
+  state_write_uint(&w, parser->fileinfo.is_32_bit, 1);
+  state_write_uint(&w, parser->fileinfo.is_little_endian, 1);
+  state_write_uint(&w, (uint16_t)parser->fileinfo.encoding, 2);
+  state_write_uint(&w, parser->row_compression_rle, 1);
+  state_write_uint(&w, parser->header_hash, 8);
+  state_write_uint(&w, parser->header_len, 8);
+  state_write_uint(&w, parser->page_len, 8);
+  state_write_uint(&w, parser->fileinfo.page_count, 8);
+  state_write_uint(&w, parser->fileinfo.row_count, 8);
+  state_write_uint(&w, parser->row_length, 8);
+  state_write_uint(&w, parser->first_data_page, 8);
+  state_write_uint(&w, parser->first_data_subheader, 8);
+  state_write_uint(&w, parser->all_column_count, 8);
+  for (size_t i = 0; i < parser->all_column_count; ++i) {
+    const struct ColumnInfo *colinfo = &parser->all_columns[i];
+    size_t name_len = strlen(colinfo->name);
+    state_write_uint(&w, colinfo->offset, 4);
+    state_write_uint(&w, colinfo->len, 4);
+    state_write_uint(&w, colinfo->format, 1);
+    state_write_uint(&w, name_len, 2);
+    state_write(&w, colinfo->name, name_len);
+  }
+  return w.pos;
+}
+
+void parser_init_from_state(struct Parser *parser, const struct ParserConfig *config,
+                            const uint8_t *state, size_t state_len) {
+  assume(parser != NULL, std::invalid_argument("parser must not be NULL"));
+  check_config(config);
+
+  memset(parser, 0, parser_struct_size());
+  parser->config = config;
+  init_arena(parser);
+
+  struct StateReader r = {.buf = state, .len = state_len, .pos = 0};
+  char magic[sizeof(PARSER_STATE_MAGIC) - 1];
+  state_read(&r, magic, sizeof(magic));
+  assume(!memcmp(magic, PARSER_STATE_MAGIC, sizeof(magic)),
+         std::invalid_argument("Invalid parser state"));
+  parser->fileinfo.is_32_bit = state_read_uint(&r, 1);
+  parser->fileinfo.is_little_endian = state_read_uint(&r, 1);
+  parser->fileinfo.need_byteswap = parser->fileinfo.is_little_endian != machine_is_little_endian();
+  parser->fileinfo.encoding = (enum Encoding)(int16_t)state_read_uint(&r, 2);
+  parser->row_compression_rle = state_read_uint(&r, 1);
+  parser->header_hash = state_read_uint(&r, 8);
+  parser->header_len = state_read_uint(&r, 8);
+  parser->page_len = state_read_uint(&r, 8);
+  parser->fileinfo.page_count = state_read_uint(&r, 8);
+  parser->fileinfo.row_count = state_read_uint(&r, 8);
+  parser->row_length = state_read_uint(&r, 8);
+  parser->first_data_page = state_read_uint(&r, 8);
+  parser->first_data_subheader = state_read_uint(&r, 8);
+  parser->fileinfo.column_count = state_read_uint(&r, 8);
+  assume(parser->page_len > 0 && parser->header_len > 0 && parser->row_length > 0 &&
+             parser->row_length < UINT32_MAX && parser->fileinfo.column_count > 0 &&
+             parser->fileinfo.column_count <= state_len,
+         std::invalid_argument("Invalid parser state"));
+  parser->header_count = compute_header_count(parser);
+  assume(parser->first_data_page < parser->header_count &&
+             parser->first_data_subheader <= UINT16_MAX,
+         std::invalid_argument("Invalid parser state"));
+
+  // Check that the state belongs to this file (the hash covers the SAS magic, too)
+  handle_pagefault(parser, 0, HEADER_HASH_LEN);
+  assume(hash_header(parser) == parser->header_hash,
+         std::invalid_argument("Parser state was written for a different file"));
+
+  alloc_row_buffers(parser);
+  alloc_string_column_bitmap(parser);
+  parser->fileinfo.columns = (struct ColumnInfo *)parserzalloc(
+      parser, sizeof(struct ColumnInfo) * parser->fileinfo.column_count);
+  for (size_t i = 0; i < parser->fileinfo.column_count; ++i) {
+    struct ColumnInfo *colinfo = &parser->fileinfo.columns[i];
+    colinfo->offset = state_read_uint(&r, 4);
+    colinfo->len = state_read_uint(&r, 4);
+    colinfo->format = (enum ColumnFormat)state_read_uint(&r, 1);
+    size_t name_len = state_read_uint(&r, 2);
+    colinfo->name = (char *)parserzalloc(parser, name_len + 1);
+    state_read(&r, colinfo->name, name_len);
+    assume(is_valid_range(colinfo->offset, colinfo->len, parser->row_length) &&
+               colinfo->format > column_format_none && colinfo->format <= column_format_datetime &&
+               (colinfo->format < column_format_double || (colinfo->len >= 3 && colinfo->len <= 8)),
+           std::invalid_argument("Invalid parser state"));
+  }
+
+  parser->current_page = parser->first_data_page;
+  parser->current_subheader = parser->first_data_subheader;
+  finish_init(parser);
+}
+
+// Page index serialization
+//
+// Layout (little-endian):
+//   magic, header_hash u64, header_len u64, page_len u64, header_count u64, row_length u64,
+//   first_data_page u64, first_data_subheader u64, n_rows u64, n_subheaders u64,
+//   (header_count - first_data_page) * (type u16, block_count u16, subheader_count u16,
+//                                       first_row u64,
+//                                       meta pages: subheader_count * (offset u32, len u32,
+//                                                                      signature u32,
+//                                                                      truncated u8))
+
+#define PAGE_INDEX_MAGIC "SAS7BDATINDEX001"
+
+size_t parser_serialize_page_index(struct Parser *parser, uint8_t *buf, size_t buf_len) {
+  parser_build_page_index(parser);
+  const struct PageIndexEntry *index = parser->page_index;
+  struct StateWriter w = {.buf = buf, .len = buf_len, .pos = 0};
+  state_write(&w, PAGE_INDEX_MAGIC, strlen(PAGE_INDEX_MAGIC));
+  state_write_uint(&w, parser->header_hash, 8);
+  state_write_uint(&w, parser->header_len, 8);
+  state_write_uint(&w, parser->page_len, 8);
+  state_write_uint(&w, parser->header_count, 8);
+  state_write_uint(&w, parser->row_length, 8);
+  state_write_uint(&w, parser->first_data_page, 8);
+  state_write_uint(&w, parser->first_data_subheader, 8);
+  state_write_uint(&w, index[parser->header_count].first_row, 8);
+  state_write_uint(&w, index[parser->header_count].first_subheader, 8);
+  for (size_t page_idx = parser->first_data_page; page_idx < parser->header_count; ++page_idx) {
+    const struct PageIndexEntry *entry = &index[page_idx];
+    state_write_uint(&w, entry->type, 2);
+    state_write_uint(&w, entry->block_count, 2);
+    state_write_uint(&w, entry->subheader_count, 2);
+    state_write_uint(&w, entry->first_row, 8);
+    if (!page_may_have_data_subheaders(entry->type)) {
+      continue;
+    }
+    for (size_t i = 0; i < entry->subheader_count; ++i) {
+      const struct PageIndexSubheader *sh =
+          &parser->page_index_subheaders[entry->first_subheader + i];
+      state_write_uint(&w, sh->offset, 4);
+      state_write_uint(&w, sh->len, 4);
+      state_write_uint(&w, sh->signature, 4);
+      state_write_uint(&w, sh->truncated, 1);
+    }
+  }
+  return w.pos;
+}
+
+bool parser_load_page_index(struct Parser *parser, const uint8_t *buf, size_t buf_len) {
+  struct StateReader r = {.buf = buf, .len = buf_len, .pos = 0};
+  char magic[sizeof(PAGE_INDEX_MAGIC) - 1];
+  state_read(&r, magic, sizeof(magic));
+  assume(!memcmp(magic, PAGE_INDEX_MAGIC, sizeof(magic)),
+         std::invalid_argument("Invalid page index"));
+  if (state_read_uint(&r, 8) != parser->header_hash ||
+      state_read_uint(&r, 8) != parser->header_len ||
+      state_read_uint(&r, 8) != parser->page_len ||
+      state_read_uint(&r, 8) != parser->header_count ||
+      state_read_uint(&r, 8) != parser->row_length ||
+      state_read_uint(&r, 8) != parser->first_data_page ||
+      state_read_uint(&r, 8) != parser->first_data_subheader) {
+    return false;
+  }
+  size_t n_rows = state_read_uint(&r, 8);
+  size_t n_subheaders = state_read_uint(&r, 8);
+  // Each subheader takes 13 bytes
+  assume(n_subheaders <= buf_len / 13, std::invalid_argument("Invalid page index"));
+  struct PageIndexEntry *index = (struct PageIndexEntry *)parserzalloc(
+      parser, (parser->header_count + 1) * sizeof(struct PageIndexEntry));
+  struct PageIndexSubheader *subheaders = (struct PageIndexSubheader *)parserzalloc(
+      parser, (n_subheaders + 1) * sizeof(struct PageIndexSubheader));
+  size_t next_subheader = 0, prev_first_row = 0;
+  for (size_t page_idx = parser->first_data_page; page_idx < parser->header_count; ++page_idx) {
+    struct PageIndexEntry *entry = &index[page_idx];
+    entry->type = state_read_uint(&r, 2);
+    entry->block_count = state_read_uint(&r, 2);
+    entry->subheader_count = state_read_uint(&r, 2);
+    entry->first_row = state_read_uint(&r, 8);
+    entry->first_subheader = next_subheader;
+    assume(entry->first_row >= prev_first_row && entry->first_row <= n_rows,
+           std::invalid_argument("Invalid page index"));
+    prev_first_row = entry->first_row;
+    if (!page_may_have_data_subheaders(entry->type)) {
+      continue;
+    }
+    assume(entry->subheader_count <= n_subheaders - next_subheader,
+           std::invalid_argument("Invalid page index"));
+    for (size_t i = 0; i < entry->subheader_count; ++i) {
+      struct PageIndexSubheader *sh = &subheaders[next_subheader++];
+      sh->offset = state_read_uint(&r, 4);
+      sh->len = state_read_uint(&r, 4);
+      sh->signature = state_read_uint(&r, 4);
+      sh->truncated = state_read_uint(&r, 1);
+    }
+  }
+  assume(next_subheader == n_subheaders && r.pos == r.len,
+         std::invalid_argument("Invalid page index"));
+  index[parser->header_count].first_row = n_rows;
+  index[parser->header_count].first_subheader = n_subheaders;
+  parser->page_index = index;
+  parser->page_index_subheaders = subheaders;
+  return true;
+}
+
+// Parallel parsing
+
+void parser_init_child(struct Parser *child, const struct Parser *parent,
+                       const struct ParserConfig *config) {
+  assume(child != NULL && parent != NULL, std::invalid_argument("parser must not be NULL"));
+  assume(config->on_pagefault != NULL, std::invalid_argument("on_pagefault must not be NULL"));
+  assume(config->on_row != NULL || config->on_rows != NULL,
+         std::invalid_argument("on_row or on_rows must not be NULL"));
+  assume(!config->metadata_only, std::invalid_argument("Child parsers can't be metadata-only"));
+
+  // Share the (read-only after parser_init()) metadata, but not buffers or position
+  memcpy(child, parent, parser_struct_size());
+  child->config = config;
+  child->parent = parent;
+  init_arena(child);
+  child->data = {};
+  child->data_min_offset = 0;
+  alloc_row_buffers(child);
+  parser_seek_page(child, child->first_data_page);
+}
+
+struct PageRange {
+  std::mutex lock;
+  size_t start, stop;
+};
+
+struct ParallelParse {
+  struct Parser *const *children;
+  size_t n_children;
+  struct PageRange *ranges;
+  std::atomic<bool> failed;
+  std::mutex error_lock;
+  std::exception_ptr error;
+};
+
+static bool page_range_pop(struct PageRange *range, size_t *page_idx) {
+  std::lock_guard<std::mutex> guard(range->lock);
+  if (range->start >= range->stop) {
+    return false;
+  }
+  *page_idx = range->start++;
+  return true;
+}
+
+// Move the back half of the largest range of another worker to 'range'.
+static bool page_range_steal(struct ParallelParse *pp, struct PageRange *range) {
+  while (true) {
+    struct PageRange *victim = NULL;
+    size_t victim_size = 0;
+    for (size_t i = 0; i < pp->n_children; ++i) {
+      std::lock_guard<std::mutex> guard(pp->ranges[i].lock);
+      if (pp->ranges[i].stop - pp->ranges[i].start > victim_size) {
+        victim = &pp->ranges[i];
+        victim_size = victim->stop - victim->start;
+      }
+    }
+    if (victim == NULL) {
+      return false;
+    }
+    size_t start, stop;
+    {
+      std::lock_guard<std::mutex> guard(victim->lock);
+      if (victim->start >= victim->stop) {
+        // Raced with the owner or another thief
+        continue;
+      }
+      stop = victim->stop;
+      start = stop - (victim->stop - victim->start + 1) / 2;
+      victim->stop = start;
+    }
+    std::lock_guard<std::mutex> guard(range->lock);
+    range->start = start;
+    range->stop = stop;
+    return true;
+  }
+}
+
+static void parse_parallel_worker(struct ParallelParse *pp, size_t worker_idx) {
+  struct Parser *child = pp->children[worker_idx];
+  struct PageRange *range = &pp->ranges[worker_idx];
+  try {
+    size_t page_idx;
+    while (!pp->failed.load(std::memory_order_relaxed) &&
+           (page_range_pop(range, &page_idx) ||
+            (page_range_steal(pp, range) && page_range_pop(range, &page_idx)))) {
+      parser_seek_page(child, page_idx);
+      while (child->current_page == page_idx) {
+        parse_current_page(child);
+      }
+    }
+  } catch (...) {
+    std::lock_guard<std::mutex> guard(pp->error_lock);
+    if (!pp->error) {
+      pp->error = std::current_exception();
+    }
+    pp->failed = true;
+  }
+}
+
+void parse_parallel(struct Parser *parser, struct Parser *const *children, size_t n_children) {
+  assume(n_children > 0, std::invalid_argument("Need at least one child parser"));
+  for (size_t i = 0; i < n_children; ++i) {
+    assume(children[i]->parent == parser, std::invalid_argument("Not a child of this parser"));
+  }
+  parser_build_page_index(parser);
+
+  std::vector<struct PageRange> ranges(n_children);
+  size_t n_pages = parser->header_count - parser->first_data_page;
+  for (size_t i = 0; i < n_children; ++i) {
+    children[i]->page_index = parser->page_index;
+    children[i]->page_index_subheaders = parser->page_index_subheaders;
+    ranges[i].start = parser->first_data_page + n_pages * i / n_children;
+    ranges[i].stop = parser->first_data_page + n_pages * (i + 1) / n_children;
+  }
+
+  struct ParallelParse pp = {.children = children,
+                             .n_children = n_children,
+                             .ranges = ranges.data(),
+                             .failed = false,
+                             .error_lock = {},
+                             .error = nullptr};
+  std::vector<std::thread> threads;
+  try {
+    for (size_t i = 1; i < n_children; ++i) {
+      threads.emplace_back(parse_parallel_worker, &pp, i);
+    }
+  } catch (...) {
+    pp.failed = true;
+    for (std::thread &thread : threads) {
+      thread.join();
+    }
+    throw;
+  }
+  parse_parallel_worker(&pp, 0);
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  if (pp.error) {
+    std::rethrow_exception(pp.error);
   }
 }
 
 size_t column_last_known_space_offset(const struct Parser *parser,
                                       const struct ColumnInfo *colinfo) {
+  return column_last_known_space_offset_in_batch(parser, colinfo, 0);
+}
+
+size_t column_last_known_space_offset_in_batch(const struct Parser *parser,
+                                               const struct ColumnInfo *colinfo,
+                                               size_t batch_row_idx) {
   assert2(colinfo->len < SIZE_MAX);
   assert2(colinfo->offset < SIZE_MAX - colinfo->len - 1);
-  size_t first_unknown = bitmap_get_last_bit(parser->is_space_byte, colinfo->offset,
-                                             colinfo->offset + colinfo->len, 0);
+  // Rows skipped by the row filter are not passed to on_rows()
+  batch_row_idx += parser->current_batch_row;
+  assert2(batch_row_idx < parser->row_batch_size);
+  size_t first_unknown =
+      bitmap_get_last_bit(batch_row_is_space_byte(parser, batch_row_idx), colinfo->offset,
+                          colinfo->offset + colinfo->len, 0);
   return first_unknown + (first_unknown != SIZE_MAX);
 }
+
+// Number type inference
+
+void number_stats_init(struct NumberStats *stats) {
+  *stats = {.count = 0,
+            .any_missing = false,
+            .all_integral = true,
+            .all_float32_exact = true,
+            .min = INFINITY,
+            .max = -INFINITY};
+}
+
+void number_stats_update(struct NumberStats *stats, const double *values, size_t n) {
+  bool any_missing = false, all_integral = true, all_float32_exact = true;
+  double min = stats->min, max = stats->max;
+  for (size_t i = 0; i < n; ++i) {
+    double value = values[i];
+    if (std::isnan(value)) {
+      any_missing = true;
+      continue;
+    }
+    all_integral &= std::trunc(value) == value;
+    all_float32_exact &= (double)(float)value == value;
+    min = std::min(min, value);
+    max = std::max(max, value);
+  }
+  stats->count += n;
+  stats->any_missing |= any_missing;
+  stats->all_integral &= all_integral;
+  stats->all_float32_exact &= all_float32_exact;
+  stats->min = min;
+  stats->max = max;
+}
+
+enum ColumnFormat number_stats_narrowest_format(const struct NumberStats *stats) {
+  if (stats->count == 0) {
+    return column_format_double;
+  }
+  if (!stats->any_missing && stats->all_integral) {
+    // Signed types first, so that columns with and without negative values agree more often
+    static const struct {
+      enum ColumnFormat format;
+      double min, max;
+    } int_formats[] = {
+        {column_format_int8, INT8_MIN, INT8_MAX},
+        {column_format_uint8, 0, UINT8_MAX},
+        {column_format_int16, INT16_MIN, INT16_MAX},
+        {column_format_uint16, 0, UINT16_MAX},
+        {column_format_int32, INT32_MIN, INT32_MAX},
+        {column_format_uint32, 0, UINT32_MAX},
+        // Exclusive upper bounds 2^63 and 2^64, which are not representable in (u)int64
+        {column_format_int64, -0x1p63, 0x1p63},
+        {column_format_uint64, 0, 0x1p64},
+    };
+    for (const auto &int_format : int_formats) {
+      bool is_64_bit = int_format.format == column_format_int64 ||
+                       int_format.format == column_format_uint64;
+      if (stats->min >= int_format.min &&
+          (is_64_bit ? stats->max < int_format.max : stats->max <= int_format.max)) {
+        return int_format.format;
+      }
+    }
+  }
+  return stats->all_float32_exact ? column_format_float : column_format_double;
+}
@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include "assume.hpp"
 #include "bitmap.hpp"
 
@@ -16,17 +18,140 @@
 
 #define restrict __restrict__
 
-typedef size_t sas_decompressor(const uint8_t *restrict in, size_t inlen, uint8_t *restrict out,
-                                size_t outlen, const struct bitmap *restrict is_string_column_byte,
-                                struct bitmap *restrict is_space_byte);
+// Decompressors (rle() and rdc()) stop after writing 'outlen_needed' bytes. 'out' must be
+// followed by DECOMPRESSION_OUTPUT_SLACK writable bytes, and bytes after the returned length may
+// be clobbered.
+
+// Check if the output range [outpos, outpos + nbytes) contains no selected byte
+#define rle_skip_output(nbytes)                                                                    \
+  (next_selected_byte != NULL && next_selected_byte[outpos] >= outpos + (nbytes))
+
+// Mark the bytes of string columns in a run of blanks (spaces or NULs) as spaces, up to 'outlen'
+#define mark_spaces(nbytes)                                                                    \
+  bitmap_or(is_space_byte, is_string_column_byte, outpos, std::min(outpos + (nbytes), outlen))
+
+// Longest RLE run: 0x00 with eob = 15 and count byte 255. Longer than any RDC item.
+#define RLE_MAX_RUN (64 + 255 + 15 * 256)
+// Output buffers must have this many writable bytes after 'outlen', see rle() and rdc()
+#define DECOMPRESSION_OUTPUT_SLACK (RLE_MAX_RUN + 16)
+// Input bytes that the fast loop of rle() may read after a control byte, except for 0x00 runs
+#define RLE_FAST_INPUT_SLACK 80
+
+// Copy and fill 'len' bytes. Short ranges are written as a single 16-byte block, ie. up to 15
+// bytes past 'len', which is faster than a variable-length memcpy or memset.
+static void copy16_overrun(uint8_t *restrict dst, const uint8_t *restrict src, size_t len) {
+  if (len <= 16) {
+    memcpy(dst, src, 16);
+  } else {
+    memcpy(dst, src, len);
+  }
+}
 
+static void fill16_overrun(uint8_t *restrict dst, uint8_t value, size_t len) {
+  if (len <= 16) {
+    uint8_t pattern[16];
+    memset(pattern, value, sizeof(pattern));
+    memcpy(dst, pattern, 16);
+  } else {
+    memset(dst, value, len);
+  }
+}
+
+// If 'next_selected_byte' is not NULL, next_selected_byte[i] is the first byte >= i that is
+// needed by the caller (or outlen), and output for ranges that contain no needed byte is skipped.
 static size_t rle(const uint8_t *restrict in, size_t inlen, uint8_t *restrict out, size_t outlen,
+                  size_t outlen_needed, const uint32_t *restrict next_selected_byte,
                   const struct bitmap *restrict is_string_column_byte,
                   struct bitmap *restrict is_space_byte) {
   size_t inpos = 0;
   size_t outpos = 0;
-  bitmap_set(is_space_byte, 0, bitmap_size(is_space_byte), false);
-  while (inpos < inlen) {
+
+  // Fast loop: while at least RLE_FAST_INPUT_SLACK input bytes are left, tokens are decoded
+  // without bounds checks and with overrunning copies and fills. Each token starts at
+  // outpos < outlen_needed <= outlen, so it ends within the output slack, and outpos is checked
+  // against outlen once, after the loop.
+  while (outpos < outlen_needed && inpos + RLE_FAST_INPUT_SLACK <= inlen) {
+    uint8_t ctrl = in[inpos] & 0xF0;
+    uint8_t eob = in[inpos] & 0x0F;
+    size_t nbytes;
+    switch (ctrl) {
+    case 0x00:
+      nbytes = in[inpos + 1] + 64 + eob * 256;
+      if (inpos + 2 + nbytes + 15 > inlen) {
+        goto safe_loop;
+      }
+      if (!rle_skip_output(nbytes)) {
+        copy16_overrun(&out[outpos], &in[inpos + 2], nbytes);
+      }
+      inpos += 2 + nbytes;
+      break;
+
+    case 0x40:
+      nbytes = in[inpos + 1] + 18 + eob * 256;
+      if (!rle_skip_output(nbytes)) {
+        fill16_overrun(&out[outpos], in[inpos + 2], nbytes);
+      }
+      inpos += 3;
+      break;
+
+    case 0x60:
+    case 0x70:
+      nbytes = in[inpos + 1] + 17 + eob * 256;
+      if (!rle_skip_output(nbytes)) {
+        mark_spaces(nbytes);
+        fill16_overrun(&out[outpos], ctrl == 0x60 ? 0x20 : 0x00, nbytes);
+      }
+      inpos += 2;
+      break;
+
+    case 0x80:
+    case 0x90:
+    case 0xA0:
+    case 0xB0:
+      nbytes = eob + (ctrl == 0x80 ? 1 : ctrl == 0x90 ? 17 : ctrl == 0xA0 ? 33 : 49);
+      if (!rle_skip_output(nbytes)) {
+        copy16_overrun(&out[outpos], &in[inpos + 1], nbytes);
+      }
+      inpos += 1 + nbytes;
+      break;
+
+    case 0xC0:
+      nbytes = eob + 3;
+      if (!rle_skip_output(nbytes)) {
+        fill16_overrun(&out[outpos], in[inpos + 1], nbytes);
+      }
+      inpos += 2;
+      break;
+
+    case 0xD0:
+      nbytes = eob + 2;
+      if (!rle_skip_output(nbytes)) {
+        fill16_overrun(&out[outpos], 0x40, nbytes);
+      }
+      inpos += 1;
+      break;
+
+    case 0xE0:
+    case 0xF0:
+      nbytes = eob + 2;
+      if (!rle_skip_output(nbytes)) {
+        mark_spaces(nbytes);
+        fill16_overrun(&out[outpos], ctrl == 0xE0 ? 0x20 : 0x00, nbytes);
+      }
+      inpos += 1;
+      break;
+
+    default:
+      assume(false, sas7bdat_error("Unknown control character"));
+    }
+
+    outpos += nbytes;
+  }
+  check_read(outpos <= outlen);
+
+safe_loop:
+  // Remaining tokens, with exact bounds checks
+  while (inpos < inlen && outpos < outlen_needed) {
     uint8_t ctrl = in[inpos] & 0xF0;
     uint8_t eob = in[inpos] & 0x0F;
     check_read(ctrl == 0xD0 || ctrl == 0xE0 || ctrl == 0xF0 || inpos + 1 < inlen);
@@ -34,25 +159,32 @@ static size_t rle(const uint8_t *restrict in, size_t inlen, uint8_t *restrict ou
     switch (ctrl) {
     case 0x00:
       nbytes = in[inpos + 1] + 64 + eob * 256;
-      safe_memmove(out, outpos, outlen, in, inpos + 2, inlen, nbytes);
+      check_read(inpos + 2 + nbytes <= inlen);
+      check_read(outpos + nbytes <= outlen);
+      if (!rle_skip_output(nbytes)) {
+        safe_memmove(out, outpos, outlen, in, inpos + 2, inlen, nbytes);
+      }
       inpos += 2 + nbytes;
       break;
 
     case 0x40:
       nbytes = in[inpos + 1] + 18 + eob * 256;
       check_read(inpos + 2 < inlen);
-      safe_memset(out, outpos, outlen, in[inpos + 2], nbytes);
+      check_read(outpos + nbytes <= outlen);
+      if (!rle_skip_output(nbytes)) {
+        safe_memset(out, outpos, outlen, in[inpos + 2], nbytes);
+      }
       inpos += 3;
       break;
 
     case 0x60:
     case 0x70:
       nbytes = in[inpos + 1] + 17 + eob * 256;
-      // todo(perf) optimize: 50% of cases within single cell max 4% faster
       check_read(outpos + nbytes <= outlen);
-      bitmap_or(is_space_byte, is_string_column_byte, outpos, outpos + nbytes);
-      // todo(perf) skip memset?
-      safe_memset(out, outpos, outlen, ctrl == 0x60 ? 0x20 : 0x00, nbytes);
+      if (!rle_skip_output(nbytes)) {
+        mark_spaces(nbytes);
+        safe_memset(out, outpos, outlen, ctrl == 0x60 ? 0x20 : 0x00, nbytes);
+      }
       inpos += 2;
       break;
 
@@ -61,19 +193,29 @@ static size_t rle(const uint8_t *restrict in, size_t inlen, uint8_t *restrict ou
     case 0xA0:
     case 0xB0:
       nbytes = eob + (ctrl == 0x80 ? 1 : ctrl == 0x90 ? 17 : ctrl == 0xA0 ? 33 : 49);
-      safe_memmove(out, outpos, outlen, in, inpos + 1, inlen, nbytes);
+      check_read(inpos + 1 + nbytes <= inlen);
+      check_read(outpos + nbytes <= outlen);
+      if (!rle_skip_output(nbytes)) {
+        safe_memmove(out, outpos, outlen, in, inpos + 1, inlen, nbytes);
+      }
       inpos += 1 + nbytes;
       break;
 
     case 0xC0:
       nbytes = eob + 3;
-      safe_memset(out, outpos, outlen, in[inpos + 1], nbytes);
+      check_read(outpos + nbytes <= outlen);
+      if (!rle_skip_output(nbytes)) {
+        safe_memset(out, outpos, outlen, in[inpos + 1], nbytes);
+      }
       inpos += 2;
       break;
 
     case 0xD0:
       nbytes = eob + 2;
-      safe_memset(out, outpos, outlen, 0x40, nbytes);
+      check_read(outpos + nbytes <= outlen);
+      if (!rle_skip_output(nbytes)) {
+        safe_memset(out, outpos, outlen, 0x40, nbytes);
+      }
       inpos += 1;
       break;
 
@@ -81,8 +223,10 @@ static size_t rle(const uint8_t *restrict in, size_t inlen, uint8_t *restrict ou
     case 0xF0:
       nbytes = eob + 2;
       check_read(outpos + nbytes <= outlen);
-      bitmap_or(is_space_byte, is_string_column_byte, outpos, outpos + nbytes);
-      safe_memset(out, outpos, outlen, ctrl == 0xE0 ? 0x20 : 0x00, nbytes);
+      if (!rle_skip_output(nbytes)) {
+        mark_spaces(nbytes);
+        safe_memset(out, outpos, outlen, ctrl == 0xE0 ? 0x20 : 0x00, nbytes);
+      }
       inpos += 1;
       break;
 
@@ -95,66 +239,95 @@ static size_t rle(const uint8_t *restrict in, size_t inlen, uint8_t *restrict ou
   return outpos;
 }
 
+// Back references may point into unselected bytes, so RDC only stops early.
+//
+// Each control word describes 16 items, from its most significant bit: 0 bits are literal
+// bytes, 1 bits are fills or back references. Runs of literal bytes are found with clz and
+// copied at once. Like rle(), only blank fills are recorded in 'is_space_byte'; blanks that are
+// literals or back references are left to the caller's whitespace scan.
 static size_t rdc(const uint8_t *restrict in, size_t inlen, uint8_t *restrict out, size_t outlen,
-                  const struct bitmap *restrict is_string_column_byte,
+                  size_t outlen_needed, const struct bitmap *restrict is_string_column_byte,
                   struct bitmap *restrict is_space_byte) {
   size_t inpos = 0;
   size_t outpos = 0;
-  while (inpos + 1 < inlen) {
-    uint16_t ctrl = (in[inpos] << 8) + in[inpos + 1];
+  while (inpos + 1 < inlen && outpos < outlen_needed) {
+    uint32_t ctrl = (in[inpos] << 8) + in[inpos + 1];
     inpos += 2;
 
-    for (size_t i = 0; i < 16; ++i) {
-      size_t nbytes;
-      uint16_t current_bit = 1 << (15 - i);
-      if ((ctrl & current_bit) == 0) {
-        if (inpos >= inlen) {
+    for (size_t i = 0; i < 16;) {
+      // Number of 0 bits from item i on; the sentinel bit stops the count after item 15
+      size_t nbytes = __builtin_clz((ctrl << (16 + i)) | (1u << (15 + i)));
+      if (nbytes > 0) {
+        if (inpos + nbytes > inlen) {
+          // Truncated input: stop after the available literal bytes
+          nbytes = inlen - inpos;
+          check_read(outpos + nbytes <= outlen);
+          memcpy(&out[outpos], &in[inpos], nbytes);
+          return outpos + nbytes;
+        }
+        check_read(outpos + nbytes <= outlen);
+        if (inpos + 16 <= inlen) {
+          copy16_overrun(&out[outpos], &in[inpos], nbytes);
+        } else {
+          memcpy(&out[outpos], &in[inpos], nbytes);
+        }
+        inpos += nbytes;
+        outpos += nbytes;
+        i += nbytes;
+        if (i == 16) {
           break;
         }
-        nbytes = 1;
-        safe_memmove(out, outpos, outlen, in, inpos, inlen, nbytes);
+      }
+
+      check_read(inpos + 1 < inlen);
+      uint8_t byte1 = in[inpos];
+      uint8_t byte2 = in[inpos + 1];
+      uint8_t byte1half1 = byte1 >> 4;
+      uint8_t byte1half2 = byte1 & 0x0f;
+      inpos += 2;
+
+      switch (byte1half1) {
+      case 0:
+        nbytes = byte1 + 3;
+        check_read(outpos + nbytes <= outlen);
+        if (byte2 == 0x20 || byte2 == 0x00) {
+          mark_spaces(nbytes);
+        }
+        fill16_overrun(&out[outpos], byte2, nbytes);
+        break;
+      case 1:
+        nbytes = byte1half2 + 19 + (byte2 << 4);
+        check_read(inpos < inlen);
+        check_read(outpos + nbytes <= outlen);
+        if (in[inpos] == 0x20 || in[inpos] == 0x00) {
+          mark_spaces(nbytes);
+        }
+        fill16_overrun(&out[outpos], in[inpos], nbytes);
         inpos += 1;
-      } else {
-        check_read(inpos + 1 < inlen);
-
-        uint8_t byte1 = in[inpos];
-        uint8_t byte2 = in[inpos + 1];
-        uint8_t byte1half1 = byte1 >> 4;
-        uint8_t byte1half2 = byte1 & 0x0f;
-        inpos += 2;
-
-        switch (byte1half1) {
-        case 0:
-          nbytes = byte1 + 3;
-          // todo(perf) is_space_byte
-          safe_memset(out, outpos, outlen, byte2, nbytes);
-          break;
-        case 1:
-          nbytes = byte1half2 + 19 + (byte2 << 4);
-          check_read(inpos < inlen);
-          // todo(perf) is_space_byte
-          safe_memset(out, outpos, outlen, in[inpos], nbytes);
-          inpos += 1;
-          break;
-        case 2: {
-          size_t back_offset = byte1half2 + 3 + (byte2 << 4);
+        break;
+      default: {
+        size_t back_offset = byte1half2 + 3 + (byte2 << 4);
+        if (byte1half1 == 2) {
           check_read(inpos < inlen);
           nbytes = in[inpos] + 16;
-          check_read(outpos >= back_offset);
-          safe_memmove(out, outpos, outlen, out, outpos - back_offset, outpos, nbytes);
           inpos += 1;
-          break;
-        }
-        default: {
-          size_t back_offset = byte1half2 + 3 + (byte2 << 4);
+        } else {
           nbytes = byte1half1;
-          check_read(outpos >= back_offset);
-          safe_memmove(out, outpos, outlen, out, outpos - back_offset, outpos, nbytes);
-          break;
         }
+        check_read(outpos >= back_offset && nbytes <= back_offset);
+        check_read(outpos + nbytes <= outlen);
+        // The source ends before 'outpos', so an overrunning copy only reads from the source
+        // if it starts at least 16 bytes back
+        if (back_offset >= 16) {
+          copy16_overrun(&out[outpos], &out[outpos - back_offset], nbytes);
+        } else {
+          memcpy(&out[outpos], &out[outpos - back_offset], nbytes);
         }
+        break;
+      }
       }
       outpos += nbytes;
+      ++i;
     }
   }
   return outpos;
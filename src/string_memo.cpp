@@ -0,0 +1,141 @@
+#include <algorithm>
+#include <new>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/sas7bdat.hpp"
+#include "assume.hpp"
+#include "hash.hpp"
+#include "string_utils.hpp"
+
+// Open addressing hash table of the distinct values of a string column. Values are stored back
+// to back in 'data', in order of their codes.
+
+#define STRING_MEMO_MIN_SLOTS 64
+
+struct StringMemoEntry {
+  uint64_t hash;
+  size_t offset, len;
+};
+
+struct StringMemo {
+  size_t max_size;
+  struct StringMemoEntry *entries;
+  size_t size, entries_capacity;
+  uint8_t *data;
+  size_t data_len, data_capacity;
+  uint32_t *slots; // Code + 1 of each slot, 0 if the slot is empty
+  size_t slots_mask;
+};
+
+size_t string_memo_struct_size() { return sizeof(struct StringMemo); }
+
+void string_memo_init(struct StringMemo *memo, size_t max_size) {
+  *memo = {};
+  memo->max_size = std::min<size_t>(max_size, INT32_MAX);
+  memo->slots = (uint32_t *)calloc(STRING_MEMO_MIN_SLOTS, sizeof(uint32_t));
+  assume(memo->slots != NULL, std::bad_alloc());
+  memo->slots_mask = STRING_MEMO_MIN_SLOTS - 1;
+}
+
+void string_memo_deinit(struct StringMemo *memo) {
+  free(memo->entries);
+  free(memo->data);
+  free(memo->slots);
+  *memo = {};
+}
+
+size_t string_memo_size(const struct StringMemo *memo) { return memo->size; }
+
+const uint8_t *string_memo_value(const struct StringMemo *memo, size_t code, size_t *len) {
+  *len = memo->entries[code].len;
+  return &memo->data[memo->entries[code].offset];
+}
+
+static void string_memo_grow_slots(struct StringMemo *memo) {
+  size_t n_slots = 2 * (memo->slots_mask + 1);
+  uint32_t *slots = (uint32_t *)calloc(n_slots, sizeof(uint32_t));
+  assume(slots != NULL, std::bad_alloc());
+  for (size_t code = 0; code < memo->size; ++code) {
+    size_t slot = memo->entries[code].hash & (n_slots - 1);
+    while (slots[slot] != 0) {
+      slot = (slot + 1) & (n_slots - 1);
+    }
+    slots[slot] = code + 1;
+  }
+  free(memo->slots);
+  memo->slots = slots;
+  memo->slots_mask = n_slots - 1;
+}
+
+static void string_memo_reserve(struct StringMemo *memo, size_t len) {
+  if (memo->size == memo->entries_capacity) {
+    size_t capacity = std::max<size_t>(2 * memo->entries_capacity, 16);
+    struct StringMemoEntry *entries = (struct StringMemoEntry *)realloc(
+        memo->entries, capacity * sizeof(struct StringMemoEntry));
+    assume(entries != NULL, std::bad_alloc());
+    memo->entries = entries;
+    memo->entries_capacity = capacity;
+  }
+  if (memo->data_len + len > memo->data_capacity) {
+    size_t capacity = std::max({2 * memo->data_capacity, memo->data_len + len, (size_t)1024});
+    uint8_t *data = (uint8_t *)realloc(memo->data, capacity);
+    assume(data != NULL, std::bad_alloc());
+    memo->data = data;
+    memo->data_capacity = capacity;
+  }
+  // Load factor <= 1/2
+  if (2 * (memo->size + 1) > memo->slots_mask + 1) {
+    string_memo_grow_slots(memo);
+  }
+}
+
+// Code of s, or -1 if it is new and the memo is full
+static int32_t string_memo_get_or_insert(struct StringMemo *memo, const uint8_t *s, size_t len) {
+  uint64_t hash = hash_bytes(s, len);
+  size_t slot = hash & memo->slots_mask;
+  for (; memo->slots[slot] != 0; slot = (slot + 1) & memo->slots_mask) {
+    const struct StringMemoEntry *entry = &memo->entries[memo->slots[slot] - 1];
+    if (entry->hash == hash && entry->len == len &&
+        (len == 0 || !memcmp(&memo->data[entry->offset], s, len))) {
+      return memo->slots[slot] - 1;
+    }
+  }
+  if (memo->size == memo->max_size) {
+    return -1;
+  }
+  string_memo_reserve(memo, len);
+  // Growing the table invalidates 'slot'
+  slot = hash & memo->slots_mask;
+  while (memo->slots[slot] != 0) {
+    slot = (slot + 1) & memo->slots_mask;
+  }
+  if (len > 0) {
+    memcpy(&memo->data[memo->data_len], s, len);
+  }
+  memo->entries[memo->size] = {.hash = hash, .offset = memo->data_len, .len = len};
+  memo->data_len += len;
+  memo->slots[slot] = ++memo->size;
+  return memo->size - 1;
+}
+
+size_t string_memo_encode(struct StringMemo *memo, const struct Parser *parser,
+                          const struct ColumnInfo *colinfo, const uint8_t *first_row,
+                          size_t n_rows, size_t stride, bool have_fast_space_offsets,
+                          bool blank_as_null, int32_t *codes) {
+  const uint8_t *row = first_row;
+  for (size_t r = 0; r < n_rows; ++r, row += stride) {
+    size_t len = string_cell_len(parser, colinfo, row, r, have_fast_space_offsets);
+    if (len == 0 && blank_as_null) {
+      codes[r] = -1;
+      continue;
+    }
+    int32_t code = string_memo_get_or_insert(memo, &row[colinfo->offset], len);
+    if (code < 0) {
+      return r;
+    }
+    codes[r] = code;
+  }
+  return n_rows;
+}
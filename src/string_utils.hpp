@@ -3,13 +3,15 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#include "../include/sas7bdat.hpp"
+
 #define iswhitespace64(x)                                                                          \
   (((x) & ((uint64_t)0xffffffffffffffff - (uint64_t)0x2020202020202020)) == 0)
 #define iswhitespace32(x) (((x) & ((uint32_t)0xffffffff - (uint32_t)0x20202020)) == 0)
 #define iswhitespace16(x) (((x) & ((uint16_t)0xffff - (uint16_t)0x2020)) == 0)
 #define iswhitespace8(x) (((x) & ((uint8_t)0xff - (uint8_t)0x20)) == 0)
 
-size_t rstrip_whitespace(const uint8_t *s, size_t len) {
+static size_t rstrip_whitespace(const uint8_t *s, size_t len) {
   const uint8_t *ptr = s + len;
 
   if (len >= 8) {
@@ -42,4 +44,20 @@ size_t rstrip_whitespace(const uint8_t *s, size_t len) {
   return ptr - s;
 }
 
+// Length of the string cell of 'colinfo' in 'row', the row 'batch_row_idx' of the current
+// on_rows() call, without trailing blanks
+static size_t string_cell_len(const struct Parser *parser, const struct ColumnInfo *colinfo,
+                              const uint8_t *row, size_t batch_row_idx,
+                              bool have_fast_space_offsets) {
+  size_t len = colinfo->len;
+  if (len > 0 && have_fast_space_offsets) {
+    size_t last_known_space =
+        column_last_known_space_offset_in_batch(parser, colinfo, batch_row_idx);
+    len = last_known_space == SIZE_MAX || last_known_space <= colinfo->offset
+              ? 0
+              : last_known_space - colinfo->offset;
+  }
+  return len > 0 ? rstrip_whitespace(&row[colinfo->offset], len) : 0;
+}
+
 #endif
@@ -0,0 +1,125 @@
+#ifndef TRANSPOSE_HPP
+#define TRANSPOSE_HPP
+#include <algorithm>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Row-major to column-major copy of 8-byte values: value k of row r, at
+// first_row + r * stride + 8 * k, is copied to out[k] + 8 * r. Values are moved bit by bit, so
+// NaN payloads (SAS missing values) are preserved.
+//
+// Rows are processed in tiles so that the input rows of a tile stay in cache while the tile is
+// scattered into all columns, and each column receives TRANSPOSE_TILE_ROWS contiguous values.
+
+#define TRANSPOSE_TILE_ROWS 64
+
+static void transpose8_scalar(const uint8_t *first_row, size_t row_start, size_t row_end,
+                              size_t stride, size_t col_start, size_t col_end, uint8_t *const *out) {
+  for (size_t k = col_start; k < col_end; ++k) {
+    for (size_t r = row_start; r < row_end; ++r) {
+      memcpy(out[k] + 8 * r, first_row + r * stride + 8 * k, 8);
+    }
+  }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+// 4x4 blocks
+__attribute__((target("avx2"))) static void
+transpose8_avx2(const uint8_t *first_row, size_t n_rows, size_t stride, size_t n_columns,
+                uint8_t *const *out) {
+  for (size_t tile = 0; tile < n_rows; tile += TRANSPOSE_TILE_ROWS) {
+    size_t tile_end = std::min(tile + TRANSPOSE_TILE_ROWS, n_rows);
+    size_t tile_end4 = tile + (tile_end - tile) / 4 * 4;
+    size_t k = 0;
+    for (; k + 4 <= n_columns; k += 4) {
+      for (size_t r = tile; r < tile_end4; r += 4) {
+        const uint8_t *src = first_row + r * stride + 8 * k;
+        __m256d r0 = _mm256_loadu_pd((const double *)src);
+        __m256d r1 = _mm256_loadu_pd((const double *)(src + stride));
+        __m256d r2 = _mm256_loadu_pd((const double *)(src + 2 * stride));
+        __m256d r3 = _mm256_loadu_pd((const double *)(src + 3 * stride));
+        __m256d t0 = _mm256_unpacklo_pd(r0, r1); // r0c0 r1c0 r0c2 r1c2
+        __m256d t1 = _mm256_unpackhi_pd(r0, r1); // r0c1 r1c1 r0c3 r1c3
+        __m256d t2 = _mm256_unpacklo_pd(r2, r3);
+        __m256d t3 = _mm256_unpackhi_pd(r2, r3);
+        _mm256_storeu_pd((double *)(out[k] + 8 * r), _mm256_permute2f128_pd(t0, t2, 0x20));
+        _mm256_storeu_pd((double *)(out[k + 1] + 8 * r), _mm256_permute2f128_pd(t1, t3, 0x20));
+        _mm256_storeu_pd((double *)(out[k + 2] + 8 * r), _mm256_permute2f128_pd(t0, t2, 0x31));
+        _mm256_storeu_pd((double *)(out[k + 3] + 8 * r), _mm256_permute2f128_pd(t1, t3, 0x31));
+      }
+      transpose8_scalar(first_row, tile_end4, tile_end, stride, k, k + 4, out);
+    }
+    transpose8_scalar(first_row, tile, tile_end, stride, k, n_columns, out);
+  }
+}
+
+// 2x2 blocks
+static void transpose8_sse2(const uint8_t *first_row, size_t n_rows, size_t stride,
+                            size_t n_columns, uint8_t *const *out) {
+  for (size_t tile = 0; tile < n_rows; tile += TRANSPOSE_TILE_ROWS) {
+    size_t tile_end = std::min(tile + TRANSPOSE_TILE_ROWS, n_rows);
+    size_t tile_end2 = tile + (tile_end - tile) / 2 * 2;
+    size_t k = 0;
+    for (; k + 2 <= n_columns; k += 2) {
+      for (size_t r = tile; r < tile_end2; r += 2) {
+        const uint8_t *src = first_row + r * stride + 8 * k;
+        __m128d r0 = _mm_loadu_pd((const double *)src);
+        __m128d r1 = _mm_loadu_pd((const double *)(src + stride));
+        _mm_storeu_pd((double *)(out[k] + 8 * r), _mm_unpacklo_pd(r0, r1));
+        _mm_storeu_pd((double *)(out[k + 1] + 8 * r), _mm_unpackhi_pd(r0, r1));
+      }
+      transpose8_scalar(first_row, tile_end2, tile_end, stride, k, k + 2, out);
+    }
+    transpose8_scalar(first_row, tile, tile_end, stride, k, n_columns, out);
+  }
+}
+
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+
+// 2x2 blocks
+static void transpose8_neon(const uint8_t *first_row, size_t n_rows, size_t stride,
+                            size_t n_columns, uint8_t *const *out) {
+  for (size_t tile = 0; tile < n_rows; tile += TRANSPOSE_TILE_ROWS) {
+    size_t tile_end = std::min(tile + TRANSPOSE_TILE_ROWS, n_rows);
+    size_t tile_end2 = tile + (tile_end - tile) / 2 * 2;
+    size_t k = 0;
+    for (; k + 2 <= n_columns; k += 2) {
+      for (size_t r = tile; r < tile_end2; r += 2) {
+        const uint8_t *src = first_row + r * stride + 8 * k;
+        uint64x2_t r0 = vld1q_u64((const uint64_t *)src);
+        uint64x2_t r1 = vld1q_u64((const uint64_t *)(src + stride));
+        vst1q_u64((uint64_t *)(out[k] + 8 * r), vzip1q_u64(r0, r1));
+        vst1q_u64((uint64_t *)(out[k + 1] + 8 * r), vzip2q_u64(r0, r1));
+      }
+      transpose8_scalar(first_row, tile_end2, tile_end, stride, k, k + 2, out);
+    }
+    transpose8_scalar(first_row, tile, tile_end, stride, k, n_columns, out);
+  }
+}
+
+#endif
+
+static void transpose8(const uint8_t *first_row, size_t n_rows, size_t stride, size_t n_columns,
+                       uint8_t *const *out) {
+#if defined(__x86_64__) || defined(__i386__)
+  static const bool have_avx2 = __builtin_cpu_supports("avx2");
+  if (have_avx2) {
+    transpose8_avx2(first_row, n_rows, stride, n_columns, out);
+  } else {
+    transpose8_sse2(first_row, n_rows, stride, n_columns, out);
+  }
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+  transpose8_neon(first_row, n_rows, stride, n_columns, out);
+#else
+  transpose8_scalar(first_row, 0, n_rows, stride, 0, n_columns, out);
+#endif
+}
+
+#endif
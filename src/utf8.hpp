@@ -0,0 +1,133 @@
+#ifndef UTF8_HPP
+#define UTF8_HPP
+#include <stdint.h>
+#include <string.h>
+
+#include "../include/sas7bdat.hpp"
+#include "codepages.hpp"
+#include "string_utils.hpp"
+
+// Transcoding of SAS strings to UTF-8. Each input byte becomes at most UTF8_MAX_EXPANSION output
+// bytes. Bytes that are invalid in the source encoding become U+FFFD.
+
+#define UTF8_MAX_EXPANSION 3
+#define UTF8_REPLACEMENT_CHARACTER 0xfffd
+
+static size_t utf8_encode(uint32_t codepoint, uint8_t *out) {
+  if (codepoint < 0x80) {
+    out[0] = codepoint;
+    return 1;
+  } else if (codepoint < 0x800) {
+    out[0] = 0xc0 | (codepoint >> 6);
+    out[1] = 0x80 | (codepoint & 0x3f);
+    return 2;
+  } else {
+    out[0] = 0xe0 | (codepoint >> 12);
+    out[1] = 0x80 | ((codepoint >> 6) & 0x3f);
+    out[2] = 0x80 | (codepoint & 0x3f);
+    return 3;
+  }
+}
+
+// Length of the ASCII prefix of s
+static size_t ascii_prefix_len(const uint8_t *s, size_t len) {
+  size_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    uint64_t cs;
+    memcpy(&cs, &s[i], 8);
+    if (cs & 0x8080808080808080ull) {
+      break;
+    }
+  }
+  while (i < len && !(s[i] & 0x80)) {
+    ++i;
+  }
+  return i;
+}
+
+static size_t transcode_single_byte_to_utf8(const struct SingleByteCodepage *codepage,
+                                            const uint8_t *s, size_t len, uint8_t *out) {
+  size_t outpos = 0;
+  for (size_t i = 0; i < len;) {
+    size_t n_ascii = ascii_prefix_len(&s[i], len - i);
+    memcpy(&out[outpos], &s[i], n_ascii);
+    outpos += n_ascii;
+    i += n_ascii;
+    for (; i < len && (s[i] & 0x80); ++i) {
+      outpos += utf8_encode(codepage->high[s[i] - 0x80], &out[outpos]);
+    }
+  }
+  return outpos;
+}
+
+// Transcode the cells of a column chunk, without trailing blanks, back to back into 'out', which
+// must have room for n_rows * colinfo->len * UTF8_MAX_EXPANSION bytes. Row r is
+// out[offsets[r]:offsets[r + 1]]; offsets[0] is the offset of the first row and is set by the caller.
+static void transcode_column_to_utf8(const struct SingleByteCodepage *codepage,
+                                     const struct Parser *parser, const struct ColumnInfo *colinfo,
+                                     const uint8_t *first_row, size_t n_rows, size_t stride,
+                                     bool have_fast_space_offsets, uint8_t *out, int64_t *offsets) {
+  const uint8_t *row = first_row;
+  size_t outpos = offsets[0];
+  for (size_t r = 0; r < n_rows; ++r, row += stride) {
+    size_t len = string_cell_len(parser, colinfo, row, r, have_fast_space_offsets);
+    outpos += transcode_single_byte_to_utf8(codepage, &row[colinfo->offset], len, &out[outpos]);
+    offsets[r + 1] = outpos;
+  }
+}
+
+// Length of the valid UTF-8 sequence at the start of s, or 0 if it is invalid
+static size_t utf8_sequence_len(const uint8_t *s, size_t len) {
+  uint8_t c = s[0];
+  size_t n;
+  uint32_t min_codepoint, codepoint;
+  if (c >= 0xc2 && c <= 0xdf) {
+    n = 2, min_codepoint = 0x80, codepoint = c & 0x1f;
+  } else if (c >= 0xe0 && c <= 0xef) {
+    n = 3, min_codepoint = 0x800, codepoint = c & 0x0f;
+  } else if (c >= 0xf0 && c <= 0xf4) {
+    n = 4, min_codepoint = 0x10000, codepoint = c & 0x07;
+  } else {
+    return 0;
+  }
+  if (n > len) {
+    return 0;
+  }
+  for (size_t i = 1; i < n; ++i) {
+    if ((s[i] & 0xc0) != 0x80) {
+      return 0;
+    }
+    codepoint = (codepoint << 6) | (s[i] & 0x3f);
+  }
+  if (codepoint < min_codepoint || codepoint > 0x10ffff ||
+      (codepoint >= 0xd800 && codepoint <= 0xdfff)) {
+    return 0;
+  }
+  return n;
+}
+
+// Copy UTF-8, replacing each byte that is not part of a valid sequence (eg. of a multi-byte
+// character that was cut off by the column width) with U+FFFD
+static size_t sanitize_utf8(const uint8_t *s, size_t len, uint8_t *out) {
+  size_t outpos = 0;
+  for (size_t i = 0; i < len;) {
+    size_t n_ascii = ascii_prefix_len(&s[i], len - i);
+    memcpy(&out[outpos], &s[i], n_ascii);
+    outpos += n_ascii;
+    i += n_ascii;
+    while (i < len && (s[i] & 0x80)) {
+      size_t n = utf8_sequence_len(&s[i], len - i);
+      if (n == 0) {
+        outpos += utf8_encode(UTF8_REPLACEMENT_CHARACTER, &out[outpos]);
+        ++i;
+      } else {
+        memcpy(&out[outpos], &s[i], n);
+        outpos += n;
+        i += n;
+      }
+    }
+  }
+  return outpos;
+}
+
+#endif
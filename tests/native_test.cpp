@@ -0,0 +1,417 @@
+// Tests of the parts of the C++ API that the Python binding does not use.
+// Usage: native_test path/to/pandas_test1.sas7bdat
+#include "../src/sas7bdat.cpp"
+#include <stdio.h>
+#include <string>
+#include <unistd.h>
+#include <utility>
+
+#define CHECK(cond)                                                                                \
+  do {                                                                                             \
+    if (!(cond)) {                                                                                 \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);                     \
+      exit(1);                                                                                     \
+    }                                                                                              \
+  } while (0)
+
+typedef std::vector<std::pair<size_t, std::string>> Rows; // (parser_row_index(), row bytes)
+
+struct Recorder {
+  const std::string *file;
+  struct Parser *parser;
+  Rows rows;
+  size_t max_rows_per_call; // Of on_rows(), to make it be called again with the remaining rows
+  useconds_t row_delay;
+  size_t fail_at_row;
+};
+
+static void on_pagefault(void *userdata, size_t requested_data_start, size_t,
+                         size_t *new_data_offset, const uint8_t **new_data, size_t *new_data_len) {
+  const std::string *file = ((struct Recorder *)userdata)->file;
+  *new_data_offset = requested_data_start;
+  *new_data = (const uint8_t *)file->data();
+  *new_data_len = file->size();
+}
+
+static void on_metadata(void *, const struct FileInfo *) {
+}
+
+static void record_row(struct Recorder *rec, size_t row_idx, const uint8_t *row) {
+  if (row_idx == rec->fail_at_row) {
+    throw std::runtime_error("Failed in on_row");
+  }
+  if (rec->row_delay > 0) {
+    usleep(rec->row_delay);
+  }
+  rec->rows.push_back({row_idx, std::string((const char *)row, rec->parser->row_length)});
+}
+
+static bool on_row(void *userdata, const uint8_t *buf, bool) {
+  struct Recorder *rec = (struct Recorder *)userdata;
+  record_row(rec, parser_row_index(rec->parser), buf);
+  return false;
+}
+
+static size_t on_rows(void *userdata, const uint8_t *first_row, size_t n_rows, size_t stride,
+                      bool) {
+  struct Recorder *rec = (struct Recorder *)userdata;
+  n_rows = std::min(n_rows, rec->max_rows_per_call);
+  for (size_t i = 0; i < n_rows; ++i) {
+    record_row(rec, parser_row_index(rec->parser) + i, first_row + i * stride);
+  }
+  return n_rows;
+}
+
+static struct Recorder make_recorder(const std::string *file) {
+  return {.file = file,
+          .parser = NULL,
+          .rows = {},
+          .max_rows_per_call = SIZE_MAX,
+          .row_delay = 0,
+          .fail_at_row = SIZE_MAX};
+}
+
+static struct ParserConfig make_config(struct Recorder *rec, bool batched) {
+  return {.userdata = rec,
+          .filesize_override = 0,
+          .column_format_overrides = NULL,
+          .selected_columns = NULL,
+          .row_filter = NULL,
+          .row_filter_len = 0,
+          .metadata_only = false,
+          .max_rows = 0,
+          .max_pages = 0,
+          .arena = NULL,
+          .on_pagefault = on_pagefault,
+          .on_metadata = on_metadata,
+          .on_row = batched ? NULL : on_row,
+          .on_rows = batched ? on_rows : NULL};
+}
+
+static Rows parse_serially(const std::string *file, struct ParserArena *arena = NULL) {
+  struct Recorder rec = make_recorder(file);
+  struct ParserConfig config = make_config(&rec, false);
+  config.arena = arena;
+  struct Parser *parser = (struct Parser *)malloc(parser_struct_size());
+  rec.parser = parser;
+  parser_init(parser, &config);
+  while (parse(parser)) {
+  }
+  parser_deinit(parser);
+  free(parser);
+  return rec.rows;
+}
+
+// Rows of all children, sorted by row index. 'recs' are set up by the caller, one per child.
+static Rows parse_in_parallel(const std::string *file, std::vector<struct Recorder> &recs,
+                              bool batched) {
+  struct Recorder parent_rec = make_recorder(file);
+  struct ParserConfig parent_config = make_config(&parent_rec, false);
+  struct Parser *parent = (struct Parser *)malloc(parser_struct_size());
+  parent_rec.parser = parent;
+  parser_init(parent, &parent_config);
+  std::vector<struct ParserConfig> configs;
+  std::vector<struct Parser *> children;
+  for (struct Recorder &rec : recs) {
+    configs.push_back(make_config(&rec, batched));
+  }
+  for (size_t i = 0; i < recs.size(); ++i) {
+    children.push_back((struct Parser *)malloc(parser_struct_size()));
+    recs[i].parser = children[i];
+    parser_init_child(children[i], parent, &configs[i]);
+  }
+  std::exception_ptr error;
+  try {
+    parse_parallel(parent, children.data(), children.size());
+  } catch (...) {
+    error = std::current_exception();
+  }
+  for (struct Parser *child : children) {
+    parser_deinit(child);
+    free(child);
+  }
+  parser_deinit(parent);
+  free(parent);
+  if (error) {
+    std::rethrow_exception(error);
+  }
+  Rows rows;
+  for (const struct Recorder &rec : recs) {
+    rows.insert(rows.end(), rec.rows.begin(), rec.rows.end());
+  }
+  std::sort(rows.begin(), rows.end());
+  return rows;
+}
+
+static std::string read_file(const char *filename) {
+  FILE *f = fopen(filename, "rb");
+  CHECK(f != NULL);
+  std::string data;
+  char buf[65536];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+    data.append(buf, n);
+  }
+  fclose(f);
+  return data;
+}
+
+// A file with the data page of 'file' repeated n_pages times. The first column of row i is set
+// to i, so that every row is different.
+static std::string make_multi_page_file(const std::string &file, size_t n_pages) {
+  struct Recorder rec = make_recorder(&file);
+  struct ParserConfig config = make_config(&rec, false);
+  struct Parser *parser = (struct Parser *)malloc(parser_struct_size());
+  rec.parser = parser;
+  parser_init(parser, &config);
+  // Uncompressed rows are passed to on_row() in place, so we can find their offsets
+  std::vector<size_t> row_offsets;
+  CHECK(parser->fileinfo.page_count == 1 && parser->fileinfo.is_little_endian &&
+        parser->fileinfo.columns[0].format == column_format_double &&
+        parser->fileinfo.columns[0].len == 8);
+  size_t header_len = parser->header_len, page_len = parser->page_len,
+         column_offset = parser->fileinfo.columns[0].offset;
+  bool is_32_bit = parser->fileinfo.is_32_bit;
+  while (parse(parser)) {
+  }
+  parser_deinit(parser);
+  free(parser);
+  for (size_t i = 0; i < rec.rows.size(); ++i) {
+    size_t offset = file.find(rec.rows[i].second, header_len);
+    CHECK(offset != std::string::npos && offset < header_len + page_len);
+    row_offsets.push_back(offset - header_len);
+  }
+
+  std::string out = file.substr(0, header_len);
+  size_t align = file[35] == '3' ? 4 : 0;
+  for (size_t i = 0; i < (is_32_bit ? 4 : 8); ++i) {
+    out[204 + align + i] = (char)(n_pages >> (8 * i));
+  }
+  for (size_t page_idx = 0; page_idx < n_pages; ++page_idx) {
+    std::string page = file.substr(header_len, page_len);
+    for (size_t i = 0; i < row_offsets.size(); ++i) {
+      double value = page_idx * row_offsets.size() + i;
+      memcpy(&page[row_offsets[i] + column_offset], &value, sizeof(value));
+    }
+    out += page;
+  }
+  return out;
+}
+
+static double first_column(const std::pair<size_t, std::string> &row) {
+  double value;
+  memcpy(&value, row.second.data(), sizeof(value));
+  return value;
+}
+
+static void test_parallel_matches_serial(const std::string &file) {
+  Rows serial = parse_serially(&file);
+  CHECK(serial.size() == 400);
+  for (size_t i = 0; i < serial.size(); ++i) {
+    CHECK(serial[i].first == i && first_column(serial[i]) == i);
+  }
+  for (bool batched : {false, true}) {
+    for (size_t n_children : {1, 2, 3, 7, 64}) {
+      std::vector<struct Recorder> recs(n_children, make_recorder(&file));
+      for (struct Recorder &rec : recs) {
+        rec.max_rows_per_call = 3;
+      }
+      CHECK(parse_in_parallel(&file, recs, batched) == serial);
+    }
+  }
+}
+
+static void test_parallel_work_stealing(const std::string &file) {
+  // The first child is slow, so the others must take over the back of its page range
+  std::vector<struct Recorder> recs(4, make_recorder(&file));
+  recs[0].row_delay = 1000;
+  CHECK(parse_in_parallel(&file, recs, false) == parse_serially(&file));
+  CHECK(recs[0].rows.size() < 100);
+  for (const auto &row : recs[0].rows) {
+    CHECK(row.first < 100);
+  }
+}
+
+static void test_parallel_error(const std::string &file) {
+  std::vector<struct Recorder> recs(3, make_recorder(&file));
+  for (struct Recorder &rec : recs) {
+    rec.fail_at_row = 250;
+  }
+  try {
+    parse_in_parallel(&file, recs, false);
+    CHECK(false);
+  } catch (const std::runtime_error &e) {
+    CHECK(!strcmp(e.what(), "Failed in on_row"));
+  }
+}
+
+static void test_page_range_steal() {
+  std::vector<struct PageRange> ranges(3);
+  ranges[0].start = ranges[0].stop = 5;
+  ranges[1].start = 0;
+  ranges[1].stop = 9;
+  ranges[2].start = 20;
+  ranges[2].stop = 23;
+  struct ParallelParse pp = {.children = NULL,
+                             .n_children = ranges.size(),
+                             .ranges = ranges.data(),
+                             .failed = false,
+                             .error_lock = {},
+                             .error = nullptr};
+  // Back half of the largest range
+  CHECK(page_range_steal(&pp, &ranges[0]));
+  CHECK(ranges[0].start == 4 && ranges[0].stop == 9 && ranges[1].start == 0 &&
+        ranges[1].stop == 4);
+  ranges[0].start = ranges[0].stop;
+  CHECK(page_range_steal(&pp, &ranges[0]));
+  CHECK(ranges[0].start == 2 && ranges[0].stop == 4 && ranges[1].stop == 2);
+  ranges[0].start = ranges[0].stop;
+  ranges[1].start = ranges[1].stop;
+  ranges[2].start = ranges[2].stop;
+  CHECK(!page_range_steal(&pp, &ranges[0]));
+}
+
+static void test_rle_truncated_copy(bool skip_output) {
+  // Copies of 10 (0x89) and 64 (0x00) bytes with only 3 input bytes left, in unselected bytes
+  // (which are skipped) or selected bytes
+  const uint8_t inputs[2][5] = {{0x89, 'a', 'b', 'c'}, {0x00, 0x00, 'a', 'b', 'c'}};
+  const size_t inlens[2] = {4, 5};
+  const size_t outlen = 100;
+  std::vector<uint32_t> next_selected_byte(outlen + 1, outlen);
+  std::vector<uint64_t> bitmaps(2 * bitmap_compute_size(outlen) / 8 + 2);
+  struct bitmap *is_string_column_byte = (struct bitmap *)bitmaps.data();
+  struct bitmap *is_space_byte = (struct bitmap *)&bitmaps[bitmaps.size() / 2];
+  bitmap_init(is_string_column_byte, outlen, false);
+  bitmap_init(is_space_byte, outlen, false);
+  std::vector<uint8_t> out(outlen + DECOMPRESSION_OUTPUT_SLACK);
+  for (size_t i = 0; i < 2; ++i) {
+    try {
+      rle(inputs[i], inlens[i], out.data(), outlen, outlen,
+          skip_output ? next_selected_byte.data() : NULL, is_string_column_byte, is_space_byte);
+      CHECK(false);
+    } catch (const sas7bdat_error &e) {
+      CHECK(!strcmp(e.what(), "Out of bounds read"));
+    }
+  }
+}
+
+static bool arena_owns(const struct ParserArena *arena, const void *ptr) {
+  for (struct ParserArenaBlock *block = arena->blocks; block != NULL; block = block->next) {
+    if (ptr >= arena_block_data(block) && ptr < arena_block_data(block) + block->size) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static size_t arena_block_count(const struct ParserArena *arena) {
+  size_t n = 0;
+  for (struct ParserArenaBlock *block = arena->blocks; block != NULL; block = block->next) {
+    ++n;
+  }
+  return n;
+}
+
+static void test_arena_blocks() {
+  struct ParserArena arena;
+  parser_arena_init(&arena);
+  CHECK(arena.blocks == NULL);
+  // Small allocations fill several geometrically growing blocks, and don't overlap
+  std::vector<uint8_t *> ptrs;
+  for (size_t i = 0; i < 2000; ++i) {
+    uint8_t *ptr = (uint8_t *)arena_zalloc(&arena, 100);
+    CHECK((uintptr_t)ptr % ARENA_ALIGNMENT == 0 && arena_owns(&arena, ptr));
+    for (size_t j = 0; j < 100; ++j) {
+      CHECK(ptr[j] == 0);
+    }
+    memset(ptr, (uint8_t)i, 100);
+    ptrs.push_back(ptr);
+  }
+  for (size_t i = 0; i < ptrs.size(); ++i) {
+    for (size_t j = 0; j < 100; ++j) {
+      CHECK(ptrs[i][j] == (uint8_t)i);
+    }
+  }
+  CHECK(arena_block_count(&arena) >= 3);
+  CHECK(arena.blocks->size > ARENA_MIN_BLOCK_SIZE);
+  CHECK(arena_zalloc(&arena, 0) != NULL);
+
+  // A large allocation gets a dedicated block, and small ones continue in the current block
+  struct ParserArenaBlock *current = arena.blocks;
+  size_t used = current->used;
+  size_t large_size = 10 * arena.next_block_size;
+  uint8_t *large = (uint8_t *)arena_zalloc(&arena, large_size);
+  CHECK(arena.blocks == current && current->next->size == large_size);
+  CHECK(large == arena_block_data(current->next) && large[large_size - 1] == 0);
+  memset(large, 0xff, large_size);
+  CHECK(arena_zalloc(&arena, 16) == arena_block_data(current) + used);
+
+  // Reset keeps only the largest block, and allocations restart at its beginning zeroed
+  parser_arena_reset(&arena);
+  CHECK(arena_block_count(&arena) == 1 && arena.blocks->size == large_size &&
+        arena.blocks->used == 0);
+  uint8_t *reused = (uint8_t *)arena_zalloc(&arena, 1000);
+  CHECK(reused == large);
+  for (size_t j = 0; j < 1000; ++j) {
+    CHECK(reused[j] == 0);
+  }
+  parser_arena_deinit(&arena);
+  CHECK(arena.blocks == NULL);
+}
+
+static void test_arena_shared_by_parsers(const std::string &file) {
+  struct ParserArena *arena = (struct ParserArena *)malloc(parser_arena_struct_size());
+  parser_arena_init(arena);
+  Rows rows = parse_serially(&file, arena);
+  CHECK(rows == parse_serially(&file));
+  // parser_deinit() doesn't free a caller-supplied arena
+  CHECK(arena->blocks != NULL);
+  size_t n_blocks = arena_block_count(arena);
+  for (size_t i = 0; i < 3; ++i) {
+    parser_arena_reset(arena);
+    struct ParserArenaBlock *kept = arena->blocks;
+    CHECK(parse_serially(&file, arena) == rows);
+    // The next parser starts in the kept block and doesn't need more blocks than the first
+    CHECK(arena_owns(arena, arena_block_data(kept)) && kept->used > 0 &&
+          arena_block_count(arena) <= n_blocks);
+  }
+  parser_arena_deinit(arena);
+  free(arena);
+}
+
+static enum ColumnFormat narrowest_format(std::vector<double> values) {
+  struct NumberStats stats;
+  number_stats_init(&stats);
+  number_stats_update(&stats, values.data(), values.size());
+  return number_stats_narrowest_format(&stats);
+}
+
+static void test_number_stats() {
+  CHECK(narrowest_format({}) == column_format_double);
+  CHECK(narrowest_format({0, 1, 1, 0}) == column_format_int8);
+  CHECK(narrowest_format({0, 200}) == column_format_uint8);
+  CHECK(narrowest_format({-1, 200}) == column_format_int16);
+  CHECK(narrowest_format({0x1p63}) == column_format_uint64);
+  CHECK(narrowest_format({1, NAN}) == column_format_float);
+  CHECK(narrowest_format({0.5}) == column_format_float);
+  CHECK(narrowest_format({0.1}) == column_format_double);
+}
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s path/to/pandas_test1.sas7bdat\n", argv[0]);
+    return 2;
+  }
+  std::string file = make_multi_page_file(read_file(argv[1]), 40);
+  test_parallel_matches_serial(file);
+  test_parallel_work_stealing(file);
+  test_parallel_error(file);
+  test_page_range_steal();
+  test_rle_truncated_copy(false);
+  test_rle_truncated_copy(true);
+  test_arena_blocks();
+  test_number_stats();
+  test_arena_shared_by_parsers(file);
+  printf("ok\n");
+  return 0;
+}